@@ -159,7 +159,9 @@ void* mi_recalloc(void* p, size_t count, size_t size);
 /// as the reallocated result since it fits in-place with the
 /// new size. If \a newsize is larger than the
 /// original \a size allocated for \a p, the bytes after \a size
-/// are uninitialized.
+/// are uninitialized. Only large blocks that have a page of their
+/// own (over 4MiB) can grow beyond their usable size, and only if
+/// the memory right after them is free.
 void* mi_expand(void* p, size_t newsize);
 
 /// Allocate \a count elements of \a size bytes.
@@ -286,6 +288,17 @@ void* mi_zalloc_small(size_t size);
 /// @see mi_good_size()
 size_t mi_usable_size(void* p);
 
+/// Return the available bytes for a batch of memory blocks.
+/// @param ptrs   array of \a count pointers to previously allocated memory (or \a NULL).
+/// @param count  number of pointers in \a ptrs.
+/// @param sizes  array of \a count entries that receive `mi_usable_size(ptrs[i])`.
+///
+/// Consecutive pointers into the same page share the segment and page lookup,
+/// so sorting the pointers (for example during a garbage collection sweep)
+/// makes the batch considerably cheaper than separate calls to mi_usable_size().
+/// @see mi_block_info_batch()
+void mi_usable_size_batch(const void* const* ptrs, size_t count, size_t* sizes);
+
 /// Return the used allocation size.
 /// @param size The minimal required size in bytes.
 /// @returns the size `n` that will be allocated, where `n >= size`.
@@ -297,6 +310,25 @@ size_t mi_usable_size(void* p);
 /// @see mi_usable_size()
 size_t mi_good_size(size_t size);
 
+/// Grow a buffer to at least \a min_needed bytes.
+/// @param p  pointer to previously allocated memory (or \a NULL).
+/// @param min_needed  the minimal required size in bytes.
+/// @param actual  if not \a NULL, set to the usable size of the returned block.
+/// @returns pointer to the re-allocated memory of at least \a min_needed bytes,
+/// or \a NULL if out of memory (in which case \a p is not freed and \a actual is
+/// set to the usable size of \a p).
+///
+/// This is meant for growing buffers of containers and string builders.
+/// If the block is too small, it grows geometrically (by 1.5x) rounded up to the
+/// size class, so the whole usable size is available and fewer re-allocations are
+/// needed. It prefers expanding in place (see mi_expand()) and only copies otherwise.
+///
+/// In C++, `mi_grow_buffer<T>(p,needed,capacity)` wraps this for buffers of
+/// trivially copyable elements, and `mi_good_capacity<T>(count)` returns the
+/// capacity that fully uses the block allocated for \a count elements.
+/// @see mi_good_size()
+void* mi_realloc_growth(void* p, size_t min_needed, size_t* actual);
+
 /// Eagerly free memory.
 /// @param force If \a true, aggressively return memory to the OS (can be expensive!)
 ///
@@ -366,8 +398,47 @@ typedef void (mi_deferred_free_fun)(bool force, unsigned long long heartbeat, vo
 /// to be called deterministically after some number of allocations
 /// (regardless of freeing or available free memory).
 /// At most one \a deferred_free function can be active.
+/// Use mi_register_deferred_free_ex() to register multiple functions.
 void   mi_register_deferred_free(mi_deferred_free_fun* deferred_free, void* arg);
 
+/// Information passed to an extended deferred free function.
+/// @see mi_register_deferred_free_ex
+typedef struct mi_deferred_free_info_s {
+  bool               force;           ///< If \a true all outstanding items should be freed.
+  unsigned long long heartbeat;       ///< A per-thread monotonically increasing count.
+  long               budget_msecs;    ///< Time budget for this call in milli-seconds (0 if none).
+  size_t             committed;       ///< Currently committed memory in bytes.
+  size_t             peak_committed;  ///< Peak committed memory in bytes.
+  size_t             commit_limit;    ///< Commit limit hint in bytes as set by #mi_option_commit_limit (0 if none).
+} mi_deferred_free_info_t;
+
+/// Type of extended deferred free functions.
+/// @param info Information about this call and the current memory pressure.
+/// @param arg Argument that was passed at registration to hold extra state.
+///
+/// @see mi_register_deferred_free_ex
+typedef void (mi_deferred_free_ex_fun)(const mi_deferred_free_info_t* info, void* arg);
+
+/// Register an extended deferred free function.
+/// @param deferred_free Address of a deferred free-ing function.
+/// @param arg Argument that will be passed on to the deferred free function.
+/// @param frequency Call the function every \a frequency heartbeats of a thread (0 or 1 for every heartbeat).
+/// @param budget_msecs Time budget per call in milli-seconds (0 for none).
+/// @returns \a true if the function was registered, or \a false if there are too many registered functions (8).
+///
+/// Like mi_register_deferred_free() but multiple functions can be registered, for example
+/// by a garbage collected runtime and a cache layered on top of mimalloc. Each function
+/// is passed the current committed memory and commit limit so it can shed memory
+/// cooperatively (mimalloc itself does not enforce the commit limit). A function that takes longer than its \a budget_msecs
+/// is called less frequently until it stays within its budget again.
+/// Forced calls (through mi_collect()) call every function regardless of its frequency.
+/// @see mi_unregister_deferred_free_ex
+bool   mi_register_deferred_free_ex(mi_deferred_free_ex_fun* deferred_free, void* arg, size_t frequency, long budget_msecs);
+
+/// Unregister an extended deferred free function registered with the same \a arg.
+/// Note that another thread may still be executing the function when this returns.
+void   mi_unregister_deferred_free_ex(mi_deferred_free_ex_fun* deferred_free, void* arg);
+
 /// Type of output functions.
 /// @param msg Message to output.
 /// @param arg Argument that was passed at registration to hold extra state.
@@ -407,12 +478,71 @@ typedef void (mi_error_fun)(int err, void* arg);
 /// * \a EINVAL: Trying to free or re-allocate an invalid pointer.
 void mi_register_error(mi_error_fun* errfun, void* arg);
 
+/// Type of allocation hook functions.
+/// @param p    The newly allocated block.
+/// @param size The requested size in bytes.
+/// @param arg  Argument that was passed at registration to hold extra state.
+///
+/// @see mi_register_hooks()
+typedef void (mi_alloc_hook_fun)(void* p, size_t size, void* arg);
+
+/// Type of free hook functions.
+/// @param p   The block that is about to be freed.
+/// @param arg Argument that was passed at registration to hold extra state.
+///
+/// @see mi_register_hooks()
+typedef void (mi_free_hook_fun)(void* p, void* arg);
+
+/// Type of reallocation hook functions.
+/// @param p       The original block (which is no longer valid if \a newp differs).
+/// @param newp    The reallocated block.
+/// @param newsize The requested new size in bytes.
+/// @param arg     Argument that was passed at registration to hold extra state.
+///
+/// @see mi_register_hooks()
+typedef void (mi_realloc_hook_fun)(void* p, void* newp, size_t newsize, void* arg);
+
+/// Register allocation hooks.
+/// @param on_alloc   Called after each successful allocation (or \a NULL).
+/// @param on_free    Called before each block is freed (or \a NULL).
+/// @param on_realloc Called after each successful reallocation (or \a NULL).
+/// @param arg        Extra argument that will be passed on to the hooks.
+///
+/// The hooks are called from the allocation entry points (like mi_malloc(),
+/// mi_calloc(), mi_malloc_aligned(), and the heap variants), from mi_free(),
+/// and from the re-allocation functions. If \a on_realloc is \a NULL, a reallocation
+/// is reported as a free of the original block followed by an allocation.
+/// Allocations and frees inside a hook are not reported, so a hook can safely
+/// allocate itself. Blocks released by mi_heap_destroy() are not reported.
+///
+/// Hooks are global and replace any earlier registered hooks; pass all \a NULL
+/// to remove them. They are best registered before other threads start allocating.
+/// When no hooks are registered, the cost is a single untaken branch per call.
+void mi_register_hooks(mi_alloc_hook_fun* on_alloc, mi_free_hook_fun* on_free, mi_realloc_hook_fun* on_realloc, void* arg);
+
 /// Is a pointer part of our heap?
 /// @param p The pointer to check.
 /// @returns \a true if this is a pointer into our heap.
 /// This function is relatively fast.
 bool mi_is_in_heap_region(const void* p);
 
+/// Find the start of the block containing a pointer.
+/// @param p    Any pointer -- not required to be previously allocated by us.
+/// @param size If not \a NULL, set to the usable size of the block (or 0).
+/// @returns the start of the block that contains \a p, or \a NULL if \a p is
+/// not inside a block of one of our pages.
+///
+/// This is meant for conservative garbage collectors and stack scanners: the
+/// lookup uses the segment map and the page metadata and takes constant time
+/// (except for interior pointers far into huge blocks).
+/// The returned block may be free, unless mimalloc is built with `-DMI_LIVE_BITS=ON`:
+/// that maintains a live bit per block (at a small cost in allocation and free)
+/// so only allocated blocks are returned. The live bits also speed up
+/// heap walks like mi_heap_visit_blocks() and detect double frees by the owning thread.
+/// For blocks in pages owned by other threads the result is only a snapshot.
+/// @see mi_is_in_heap_region()
+void* mi_block_start(const void* p, size_t* size);
+
 /// Reserve OS memory for use by mimalloc. Reserved areas are used
 /// before allocating from the OS again. By reserving a large area upfront, 
 /// allocation can be more efficient, and can be better managed on systems
@@ -565,6 +695,21 @@ mi_heap_t* mi_heap_new();
 /// heap is set to the backing heap.
 void mi_heap_delete(mi_heap_t* heap);
 
+/// Transfer the page containing a block to another heap.
+/// @param heap  The heap that takes over the page.
+/// @param p     A live block allocated in another heap of the current thread.
+/// @returns \a true if the block (and its page) now belongs to \a heap.
+///
+/// This only succeeds when \a p is the only live block in its page, which is
+/// usually the case for large and huge blocks. The block is not moved or copied,
+/// which allows handing off large buffers between subsystems that each use
+/// their own heap. Returns \a false (and leaves the block in place) if other
+/// blocks in the page are still in use, or if the page belongs to another thread.
+/// When mi_heap_realloc() (or one of its variants) needs to move a large block
+/// into a heap other than the default heap, it uses this automatically so the
+/// block can be resized in place without copying.
+bool mi_heap_adopt_page(mi_heap_t* heap, const void* p);
+
 /// Destroy a heap, freeing all its still allocated blocks.
 /// Use with care as this will free all blocks still
 /// allocated in the heap. However, this can be a very
@@ -629,6 +774,7 @@ char* mi_heap_realpath(mi_heap_t* heap, const char* fname, char* resolved_name);
 void* mi_heap_realloc(mi_heap_t* heap, void* p, size_t newsize);
 void* mi_heap_reallocn(mi_heap_t* heap, void* p, size_t count, size_t size);
 void* mi_heap_reallocf(mi_heap_t* heap, void* p, size_t newsize);
+void* mi_heap_realloc_growth(mi_heap_t* heap, void* p, size_t min_needed, size_t* actual);
 
 void* mi_heap_malloc_aligned(mi_heap_t* heap, size_t size, size_t alignment);
 void* mi_heap_malloc_aligned_at(mi_heap_t* heap, size_t size, size_t alignment, size_t offset);
@@ -756,6 +902,29 @@ bool mi_heap_check_owned(mi_heap_t* heap, const void* p);
 /// @see mi_heap_get_default()
 bool mi_check_owned(const void* p);
 
+/// Information about the block containing a pointer.
+/// @see mi_block_info_batch()
+typedef struct mi_ptr_info_s {
+  void*      block;       ///< start of the block containing the pointer (\a NULL if not a heap pointer)
+  size_t     block_size;  ///< usable size of the block (from its start)
+  mi_heap_t* heap;        ///< heap owning the block (\a NULL if the block is in an abandoned page)
+} mi_ptr_info_t;
+
+/// Return the block start, size, and owning heap for a batch of pointers.
+/// @param ptrs   array of \a count pointers into previously allocated blocks (or \a NULL).
+///               Interior pointers are allowed.
+/// @param count  number of pointers in \a ptrs.
+/// @param infos  array of \a count entries that receive the block information.
+///
+/// This answers in one pass what otherwise takes separate calls to
+/// mi_usable_size() and mi_heap_contains_block(), and is meant for garbage
+/// collectors and language runtimes. As with mi_usable_size_batch(),
+/// consecutive pointers into the same page share the segment and page lookup
+/// so it is best to pass the pointers in sorted order.
+/// Like mi_heap_contains_block(), the owning heap is only meaningful for
+/// blocks in heaps of the current thread.
+void mi_block_info_batch(const void* const* ptrs, size_t count, mi_ptr_info_t* infos);
+
 /// An area of heap space contains blocks of a single size.
 /// The bytes in freed blocks are `committed - used`.
 typedef struct mi_heap_area_s {
@@ -788,6 +957,62 @@ typedef bool (mi_block_visit_fun)(const mi_heap_t* heap, const mi_heap_area_t* a
 /// @returns \a true if all areas and blocks were visited.
 bool mi_heap_visit_blocks(const mi_heap_t* heap, bool visit_all_blocks, mi_block_visit_fun* visitor, void* arg);
 
+/// Predicate for mi_heap_free_if(); return \a true to free the \a block.
+typedef bool (mi_block_predicate_fun)(const mi_heap_t* heap, void* block, size_t block_size, void* arg);
+
+/// Free all blocks in a heap for which a predicate holds.
+/// @param heap The heap; must be owned by the current thread.
+/// @param predicate Called for every allocated block (with its usable \a block_size);
+///                  returns \a true if the block should be freed.
+/// @param arg Extra argument passed to \a predicate.
+/// @returns the number of freed blocks.
+///
+/// This walks the pages of the heap and frees the selected blocks in bulk by
+/// pushing them directly on the free list of their page, freeing pages that
+/// become empty. This is much faster than calling mi_free() per block and is
+/// meant for cache eviction and garbage collection sweeps.
+/// The predicate is called outside of any mimalloc lock and may allocate and free
+/// in other heaps, but it must not allocate or free in \a heap. As with mi_heap_destroy(),
+/// the freed blocks are not reported to the hooks registered with mi_register_hooks().
+/// @see mi_heap_sweep_unmarked()
+size_t mi_heap_free_if(mi_heap_t* heap, mi_block_predicate_fun* predicate, void* arg);
+
+/// Set the mark bit of a block.
+/// @param p Pointer to a previously allocated block (may be an aligned pointer into it).
+/// @returns \a true if the block was already marked.
+///
+/// Mark bits are kept in a side table per segment (one bit per word) that is
+/// allocated on the first mark in that segment, so blocks keep their full size
+/// and no separate hash set is needed. Marking is atomic and can be done from
+/// any thread. Use mi_block_start() first for interior pointers.
+/// @see mi_heap_sweep_unmarked()
+bool mi_block_mark(const void* p);
+
+/// Clear the mark bit of a block.
+/// @param p Pointer to a previously allocated block.
+void mi_block_unmark(const void* p);
+
+/// Is a block marked?
+/// @param p Pointer to a previously allocated block.
+/// @returns \a true if the block is marked.
+bool mi_block_is_marked(const void* p);
+
+/// Clear the mark bits of all blocks in a heap.
+/// @param heap The heap.
+void mi_heap_clear_marks(mi_heap_t* heap);
+
+/// Free all unmarked blocks in a heap.
+/// @param heap The heap; must be owned by the current thread.
+/// @returns the number of freed blocks.
+///
+/// Blocks are freed in bulk by pushing them directly on the free list of their
+/// page, and pages that become empty are freed. The mark bits of the remaining
+/// blocks are cleared so the next marking phase can start right away.
+/// As with mi_heap_destroy(), the freed blocks are not reported to the hooks
+/// registered with mi_register_hooks().
+/// @see mi_block_mark()
+size_t mi_heap_sweep_unmarked(mi_heap_t* heap);
+
 /// \}
 
 /// \defgroup options Runtime Options
@@ -827,6 +1052,11 @@ typedef enum mi_option_e {
   mi_option_allow_decommit,  ///< Enable decommitting memory (=on)
   mi_option_decommit_delay,  ///< Decommit page memory after N milli-seconds delay (25ms).
   mi_option_segment_decommit_delay, ///< Decommit large segment memory after N milli-seconds delay (500ms).
+  mi_option_commit_limit,    ///< Commit limit in MiB passed to deferred free functions as a memory pressure hint (0 = none). The limit is not enforced: allocation never fails because of it.
+  mi_option_exclude_from_fork, ///< Exclude segments from a forked child process: 1 = `MADV_DONTFORK`, 2 = `MADV_WIPEONFORK` (=0), see \ref environment.
+  mi_option_arena_reserve,   ///< Reserve address space this many KiB at a time for segments, e.g. "1g" (=1GiB on 64-bit, 0 to disable).
+  mi_option_reserve_address_space, ///< Reserve one heap space at startup from which all segments are committed in place, e.g. "64g" (=0), see \ref environment.
+  mi_option_huge_cache_max,  ///< Keep at most N MiB of freed huge segments for reuse; their memory is reset while cached (=256, 0 to disable).
 
   _mi_option_last
 } mi_option_t;
@@ -1104,6 +1334,27 @@ Use caution when using `fork` in combination with either large or huge OS pages:
 for all pages in the original process including the huge OS pages. When any memory is now written in that area, the
 OS will copy the entire 1GiB huge page (or 2MiB large page) which can cause the memory usage to grow in big increments.
 
+With `MIMALLOC_RESERVE_ADDRESS_SPACE=<size>` (e.g. `64GiB`) mimalloc reserves one large virtual address range at startup
+(without committing or accounting any memory for it) and carves all segments from it by committing them in place.
+This keeps the number of memory mappings low, reuses freed segment addresses, and lets mimalloc reject pointers
+outside that range with a simple range check. When the space is exhausted, further address space is reserved
+on demand (`MIMALLOC_ARENA_RESERVE`, 1GiB at a time by default).
+
+On Linux, `MIMALLOC_EXCLUDE_FROM_FORK=1` excludes the mimalloc segments from a forked child process (using `MADV_DONTFORK`)
+such that `fork` no longer copies the page tables of large heaps. With `MIMALLOC_EXCLUDE_FROM_FORK=2` the child gets the
+segments zero-filled instead (`MADV_WIPEONFORK`). In both cases the child cannot access (or free) any memory in the
+excluded segments: all heaps start out empty in the child and allocate from fresh segments. Segments that are not
+excluded (as they were allocated before the option was set, or when the process is near its mapping limit) are still
+present in the child and their memory can still be freed there. This is meant for
+processes that fork only to `exec` a helper process.
+Excluding a segment changes its memory mapping, so once the process uses more than half of the
+`vm.max_map_count` mappings, mimalloc no longer excludes new segments (and warns once).
+
+On Linux (with overcommit), mimalloc reserves uncommitted memory as read/write and decommits with `MADV_DONTNEED`
+such that committing or decommitting part of an arena never splits its memory mapping. In debug and secure builds,
+decommitted memory is protected to trap on invalid accesses, but only until the process is close to the
+`vm.max_map_count` limit. The current number of mappings is shown in the statistics.
+
 [linux-huge]: https://access.redhat.com/documentation/en-us/red_hat_enterprise_linux/5/html/tuning_and_optimizing_red_hat_enterprise_linux_for_oracle_9i_and_10g_databases/sect-oracle_9i_and_10g_tuning_guide-large_memory_optimization_big_pages_and_huge_pages-configuring_huge_pages_in_red_hat_enterprise_linux_4_or_5
 [windows-huge]: https://docs.microsoft.com/en-us/sql/database-engine/configure-windows/enable-the-lock-pages-in-memory-option-windows?view=sql-server-2017
 
@@ -59,6 +59,7 @@ void       _mi_error_message(int err, const char* fmt, ...);
 
 // random.c
 void       _mi_random_init(mi_random_ctx_t* ctx);
+void       _mi_random_init_weak(mi_random_ctx_t* ctx);
 void       _mi_random_split(mi_random_ctx_t* ctx, mi_random_ctx_t* new_ctx);
 uintptr_t  _mi_random_next(mi_random_ctx_t* ctx);
 uintptr_t  _mi_heap_random_next(mi_heap_t* heap);
@@ -73,6 +74,7 @@ size_t     _mi_current_thread_count(void);
 bool       _mi_preloading(void);  // true while the C runtime is not ready
 void       _mi_heap_lock_heap_queue(void);
 void       _mi_heap_unlock_heap_queue(void);
+void       _mi_fork_child(void);
 
 // os.c
 size_t     _mi_os_page_size(void);
@@ -85,14 +87,18 @@ bool       _mi_os_unprotect(void* addr, size_t size);
 bool       _mi_os_commit(void* addr, size_t size, bool* is_zero, mi_stats_t* stats);
 bool       _mi_os_decommit(void* p, size_t size, mi_stats_t* stats);
 bool       _mi_os_reset(void* p, size_t size, mi_stats_t* stats);
+bool       _mi_os_exclude_from_fork(void* addr, size_t size, int mode, bool exclude);
 // bool       _mi_os_unreset(void* p, size_t size, bool* is_zero, mi_stats_t* stats);
 size_t     _mi_os_good_alloc_size(size_t size);
 bool       _mi_os_has_overcommit(void);
+size_t     _mi_os_vma_count(bool force, size_t* max);                // number of memory mappings (Linux only)
 
 // arena.c
 void*      _mi_arena_alloc_aligned(size_t size, size_t alignment, bool* commit, bool* large, bool* is_pinned, bool* is_zero, size_t* memid, mi_os_tld_t* tld);
 void*      _mi_arena_alloc(size_t size, bool* commit, bool* large, bool* is_pinned, bool* is_zero, size_t* memid, mi_os_tld_t* tld);
 void       _mi_arena_free(void* p, size_t size, size_t memid, bool is_committed, mi_os_tld_t* tld);
+void       _mi_arena_reserve_heap_space(size_t size);
+bool       _mi_arena_memid_is_os(size_t memid);
 
 // "segment-cache.c"
 void*      _mi_segment_cache_pop(size_t size, mi_commit_mask_t* commit_mask, mi_commit_mask_t* decommit_mask, bool* large, bool* is_pinned, bool* is_zero, size_t* memid, mi_os_tld_t* tld);
@@ -100,6 +106,9 @@ bool       _mi_segment_cache_push(void* start, size_t size, size_t memid, const
 void       _mi_segment_cache_collect(bool force, mi_os_tld_t* tld);
 void       _mi_segment_map_allocated_at(const mi_segment_t* segment);
 void       _mi_segment_map_freed_at(const mi_segment_t* segment);
+mi_segment_t* _mi_segment_of(const void* p);
+void       _mi_segment_map_fork_child(void);
+bool       _mi_segment_map_init_space(void* start, size_t size);
 
 // "segment.c"
 mi_page_t* _mi_segment_page_alloc(mi_heap_t* heap, size_t block_wsize, mi_segments_tld_t* tld, mi_os_tld_t* os_tld);
@@ -107,12 +116,22 @@ void       _mi_segment_page_free(mi_page_t* page, bool force, mi_segments_tld_t*
 void       _mi_segment_page_abandon(mi_page_t* page, mi_segments_tld_t* tld);
 bool       _mi_segment_try_reclaim_abandoned( mi_heap_t* heap, bool try_all, mi_segments_tld_t* tld);
 void       _mi_segment_thread_collect(mi_segments_tld_t* tld);
-void       _mi_segment_huge_page_free(mi_segment_t* segment, mi_page_t* page, mi_block_t* block);
+bool       _mi_segment_huge_page_free(mi_segment_t* segment, mi_page_t* page, mi_block_t* block);
+void       _mi_segment_huge_page_reset(mi_segment_t* segment, mi_page_t* page, mi_block_t* block);
+void       _mi_segment_abandoned_page_free(mi_segment_t* segment, const mi_page_t* page);
+bool       _mi_segment_page_try_resize(mi_page_t* page, size_t page_size, mi_segments_tld_t* tld);
+_Atomic(uintptr_t)* _mi_segment_marks(mi_segment_t* segment, bool create);
+void       _mi_segment_marks_clear(mi_segment_t* segment, const void* start, size_t size);
 
 uint8_t*   _mi_segment_page_start(const mi_segment_t* segment, const mi_page_t* page, size_t* page_size); // page start for any page
 void       _mi_abandoned_reclaim_all(mi_heap_t* heap, mi_segments_tld_t* tld);
 void       _mi_abandoned_await_readers(void);
 void       _mi_abandoned_collect(mi_heap_t* heap, bool force, mi_segments_tld_t* tld);
+void       _mi_abandoned_fork_child(void);
+void       _mi_segments_fork_child(mi_segments_tld_t* tld);
+bool       _mi_segments_fork_excluded(void);
+bool       _mi_segment_fork_visible(const void* p);
+void       _mi_segments_fork_child_abandon(void);
 
 
 
@@ -128,16 +147,14 @@ void       _mi_heap_collect_retired(mi_heap_t* heap, bool force);
 
 void       _mi_page_use_delayed_free(mi_page_t* page, mi_delayed_t delay, bool override_never);
 size_t     _mi_page_queue_append(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_queue_t* append);
+void       _mi_page_queue_transfer(mi_heap_t* heap, mi_page_t* page);
+bool       _mi_page_huge_unlink(mi_page_t* page);
+void       _mi_heap_huge_pin(mi_heap_t* heap, bool pin);
 void       _mi_deferred_free(mi_heap_t* heap, bool force);
 
 void       _mi_page_free_collect(mi_page_t* page,bool force);
 void       _mi_page_reclaim(mi_heap_t* heap, mi_page_t* page);   // callback from segments
 
-void       _mi_page_add_detached_page(mi_page_t* page);
-void       _mi_page_remove_detached_page(mi_page_t* page);
-void       _mi_page_lock_detached_page_queue(void);
-void       _mi_page_unlock_detached_page_queue(void);
-
 size_t     _mi_bin_size(uint8_t bin);           // for stats
 uint8_t    _mi_bin(size_t size);                // for stats
 
@@ -145,6 +162,7 @@ uint8_t    _mi_bin(size_t size);                // for stats
 void       _mi_heap_destroy_pages(mi_heap_t* heap);
 void       _mi_heap_collect_abandon(mi_heap_t* heap);
 void       _mi_heap_set_default_direct(mi_heap_t* heap);
+void       _mi_heap_fork_child(mi_tld_t* tld);
 bool       _mi_heap_lock_malloc(void);
 void       _mi_heap_unlock_malloc(void);
 void       _mi_heap_lock_iterate(void);
@@ -162,9 +180,15 @@ mi_stats_t  _mi_stats_get_empty_stats(void);
 void*       _mi_page_malloc(mi_heap_t* heap, mi_page_t* page, size_t size) mi_attr_noexcept;  // called from `_mi_malloc_generic`
 void*       _mi_heap_malloc_zero(mi_heap_t* heap, size_t size, bool zero) mi_attr_noexcept;
 void*       _mi_heap_realloc_zero(mi_heap_t* heap, void* p, size_t newsize, bool zero) mi_attr_noexcept;
+bool        _mi_block_try_resize_in_place(void* p, size_t newsize);
 mi_block_t* _mi_page_ptr_unalign(const mi_segment_t* segment, const mi_page_t* page, const void* p);
-bool        _mi_free_delayed_block(mi_block_t* block);
+void        _mi_stat_free(const mi_page_t* page, const mi_block_t* block);
 void        _mi_block_zero_init(const mi_page_t* page, void* p, size_t size);
+void        _mi_hook_alloc(void* p, size_t size);
+void        _mi_hook_free(void* p);
+void        _mi_hook_realloc(void* p, void* newp, size_t newsize);
+void        _mi_hooks_suspend(void);
+void        _mi_hooks_resume(void);
 
 #if MI_DEBUG>1
 bool        _mi_page_is_valid(mi_page_t* page);
@@ -486,6 +510,37 @@ static inline mi_page_t* _mi_segment_page_of(const mi_segment_t* segment, const
   return mi_slice_to_page(slice);
 }
 
+#if MI_LIVE_BITS
+// Live bits are only written by the thread owning the segment
+static inline _Atomic(uintptr_t)* mi_block_live_word(const void* block, uintptr_t* mask) {
+  const mi_segment_t* const segment = _mi_ptr_segment(block);
+  const size_t bitidx = (size_t)((const uint8_t*)block - (const uint8_t*)segment) / MI_INTPTR_SIZE;
+  *mask = ((uintptr_t)1 << (bitidx % MI_INTPTR_BITS));
+  return &((_Atomic(uintptr_t)*)mi_atomic_load_ptr_relaxed(uintptr_t, &segment->live))[bitidx / MI_INTPTR_BITS];
+}
+
+static inline bool mi_block_is_live(const void* block) {
+  uintptr_t mask;
+  _Atomic(uintptr_t)* const word = mi_block_live_word(block, &mask);
+  return ((mi_atomic_load_relaxed(word) & mask) != 0);
+}
+
+static inline void mi_block_set_live(const void* block) {
+  uintptr_t mask;
+  _Atomic(uintptr_t)* const word = mi_block_live_word(block, &mask);
+  mi_atomic_store_relaxed(word, mi_atomic_load_relaxed(word) | mask);
+}
+
+// Returns `false` if the block was not live
+static inline bool mi_block_clear_live(const void* block) {
+  uintptr_t mask;
+  _Atomic(uintptr_t)* const word = mi_block_live_word(block, &mask);
+  const uintptr_t bits = mi_atomic_load_relaxed(word);
+  mi_atomic_store_relaxed(word, bits & ~mask);
+  return ((bits & mask) != 0);
+}
+#endif
+
 // Quick page start for initialized pages
 static inline uint8_t* _mi_page_start(const mi_segment_t* segment, const mi_page_t* page, size_t* page_size) {
   return _mi_segment_page_start(segment, page, page_size);
@@ -803,6 +858,16 @@ static inline size_t _mi_os_numa_node_count(void) {
   else return _mi_os_numa_node_count_get();
 }
 
+// -------------------------------------------------------------------
+// Allocation hooks are checked in the fast paths of allocation and
+// free and should cost just one untaken branch if none are registered.
+// -------------------------------------------------------------------
+
+extern _Atomic(bool) _mi_hooks_installed;
+static inline bool mi_hooks_installed(void) {
+  return mi_unlikely(mi_atomic_load_relaxed(&_mi_hooks_installed));
+}
+
 
 // -------------------------------------------------------------------
 // Getting the thread id should be performant as it is called in the
@@ -1067,4 +1132,43 @@ static inline void _mi_memcpy_aligned(void* dst, const void* src, size_t n) {
 #endif
 
 
+// -------------------------------------------------------------------------------
+// The `_mi_memcpy_large` is used to copy large blocks in `mi_realloc`. On x64 it
+// uses non-temporal stores for copies of at least `MI_MEMCPY_STREAM_MIN` bytes
+// so the copy does not evict the working set from the cache. The copied data is
+// usually not accessed soon after (as with growing buffers that are appended to).
+// -------------------------------------------------------------------------------
+
+#define MI_MEMCPY_STREAM_MIN  (4*MI_MiB)
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+static inline void _mi_memcpy_large(void* dst, const void* src, size_t n) {
+  if (n < MI_MEMCPY_STREAM_MIN || ((uintptr_t)dst % 16) != 0) {
+    _mi_memcpy_aligned(dst, src, n);
+    return;
+  }
+  uint8_t* d = (uint8_t*)dst;
+  const uint8_t* s = (const uint8_t*)src;
+  const size_t n64 = n & ~((size_t)63);
+  for (size_t i = 0; i < n64; i += 64) {
+    const __m128i x0 = _mm_loadu_si128((const __m128i*)(s + i));
+    const __m128i x1 = _mm_loadu_si128((const __m128i*)(s + i + 16));
+    const __m128i x2 = _mm_loadu_si128((const __m128i*)(s + i + 32));
+    const __m128i x3 = _mm_loadu_si128((const __m128i*)(s + i + 48));
+    _mm_stream_si128((__m128i*)(d + i), x0);
+    _mm_stream_si128((__m128i*)(d + i + 16), x1);
+    _mm_stream_si128((__m128i*)(d + i + 32), x2);
+    _mm_stream_si128((__m128i*)(d + i + 48), x3);
+  }
+  _mm_sfence();  // order the non-temporal stores before any later stores
+  if (n > n64) { _mi_memcpy(d + n64, s + n64, n - n64); }
+}
+#else
+static inline void _mi_memcpy_large(void* dst, const void* src, size_t n) {
+  _mi_memcpy_aligned(dst, src, n);
+}
+#endif
+
+
 #endif
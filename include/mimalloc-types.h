@@ -61,6 +61,12 @@ terms of the MIT license. A copy of the license can be found in the file
 #endif
 
 
+// Maintain a live bit per allocated block in a side table of the segment so heap walks
+// and `mi_block_start` can test liveness directly instead of walking the free lists.
+#if !defined(MI_LIVE_BITS)
+#define MI_LIVE_BITS  0
+#endif
+
 // Encoded free lists allow detection of corrupted free lists
 // and can detect buffer overflows, modify after free, and double `free`s.
 #if (MI_SECURE>=3 || MI_DEBUG>=1 || MI_PADDING > 0)
@@ -156,13 +162,20 @@ typedef int32_t  mi_ssize_t;
 #define MI_MEDIUM_OBJ_WSIZE_MAX           (MI_MEDIUM_OBJ_SIZE_MAX/MI_INTPTR_SIZE)   
 #define MI_LARGE_OBJ_SIZE_MAX             (MI_SEGMENT_SIZE/2)      // 32MiB on 64-bit
 #define MI_LARGE_OBJ_WSIZE_MAX            (MI_LARGE_OBJ_SIZE_MAX/MI_INTPTR_SIZE)
+#define MI_LARGE_BIN_OBJ_WSIZE_MAX        (32*MI_MEDIUM_OBJ_WSIZE_MAX)  // large objects up to here use size classes (and share pages)
+#define MI_LARGE_BIN_OBJ_SIZE_MAX         (MI_LARGE_BIN_OBJ_WSIZE_MAX*MI_INTPTR_SIZE)  // 4MiB on 64-bit
+#define MI_SEGMENT_MARKS_SIZE             (MI_SEGMENT_SIZE/MI_INTPTR_SIZE/8)  // one mark bit per word: 1MiB on 64-bit
 
 // Maximum number of size classes. (spaced exponentially in 12.5% increments)
 #define MI_BIN_HUGE  (73U)
+#define MI_BIN_MAP_SIZE  ((MI_BIN_HUGE + MI_INTPTR_BITS) / MI_INTPTR_BITS)  // words in a bitmap with one bit per bin (up to and including `MI_BIN_HUGE`)
 
-#if (MI_MEDIUM_OBJ_WSIZE_MAX >= 655360)
+#if (MI_LARGE_BIN_OBJ_WSIZE_MAX >= 655360)
 #error "mimalloc internal: define more bins"
 #endif
+#if (MI_LARGE_BIN_OBJ_SIZE_MAX > MI_LARGE_OBJ_SIZE_MAX/2)
+#error "mimalloc internal: large size classes must fit at least two blocks in a large page"
+#endif
 #if (MI_ALIGNMENT_MAX > MI_SEGMENT_SIZE/2)
 #error "mimalloc internal: the max aligned boundary is too large for the segment size"
 #endif
@@ -201,9 +214,9 @@ typedef struct mi_block_s {
 
 // The delayed flags are used for efficient multi-threaded free-ing
 typedef enum mi_delayed_e {
-  MI_USE_DELAYED_FREE   = 0, // push on the owning heap thread delayed list
+  MI_USE_DELAYED_FREE   = 0, // push the page on the owning heap thread delayed list
   MI_DELAYED_FREEING    = 1, // temporary: another thread is accessing the owning heap
-  MI_NO_DELAYED_FREE    = 2, // optimize: push on page local thread free queue if another block is already in the heap thread delayed free list
+  MI_NO_DELAYED_FREE    = 2, // the page is already in the heap thread delayed list; only push on the page thread free queue
   MI_NEVER_DELAYED_FREE = 3  // sticky, only resets on page reclaim
 } mi_delayed_t;
 
@@ -259,12 +272,13 @@ typedef uintptr_t mi_thread_free_t;
 // - To limit the structure size, the `xblock_size` is 32-bits only; for 
 //   blocks > MI_HUGE_BLOCK_SIZE the size is determined from the segment page size
 // - `thread_free` uses the bottom bits as a delayed-free flags to optimize
-//   concurrent frees where only the first concurrent free adds to the owning
-//   heap `thread_delayed_free` list (see `alloc.c:mi_free_block_mt`).
-//   The invariant is that no-delayed-free is only set if there is
-//   at least one block that will be added, or as already been added, to 
-//   the owning heap `thread_delayed_free` list. This guarantees that pages
-//   will be freed correctly even if only other threads free blocks.
+//   concurrent frees where only the first concurrent free pushes the page on
+//   the owning heap `thread_delayed_pages` list (see `alloc.c:mi_free_block_mt`).
+//   The invariant is that no-delayed-free is only set if the page will be
+//   added, or has already been added, to the owning heap `thread_delayed_pages`
+//   list. This guarantees that pages will be freed correctly even if only
+//   other threads free blocks; such pages are not freed until the owning
+//   heap has taken them off that list.
 typedef struct mi_page_s {
   // "owned" by the segment
   uint32_t              slice_count;       // slices in this page (0 if not a page)
@@ -293,12 +307,10 @@ typedef struct mi_page_s {
 
   struct mi_page_s*     next;                  // next page owned by this thread with the same `block_size`
   struct mi_page_s*     prev;                  // previous page owned by this thread with the same `block_size`
+  struct mi_page_s*     delayed_next;          // next page in the owning heap `thread_delayed_pages` list
   // _Atomic(uintptr_t)    tagged_ptr;
 
-  // 64-bit 9 words, 32-bit 12 words, (+2 for secure)
-  #if MI_INTPTR_SIZE==8
-  uintptr_t padding[1];
-  #endif
+  // 64-bit 10 words, 32-bit 13 words, (+2 for secure)
 } mi_page_t;
 
 
@@ -368,6 +380,17 @@ typedef struct mi_segment_s {
   size_t            abandoned_visits;   // count how often this segment is visited in the abandoned list (to force reclaim it it is too long)
   size_t            used;               // count of pages in use
   uintptr_t         cookie;             // verify addresses in debug mode: `mi_ptr_cookie(segment) == segment->cookie`  
+  _Atomic(uintptr_t*) marks;            // lazily allocated mark bits (one per word, see `heap.c:mi_block_mark`)
+  #if MI_LIVE_BITS
+  _Atomic(uintptr_t*) live;             // live bits: set for each allocated block (one per word)
+  #endif
+  int               fork_mode;          // `mi_option_exclude_from_fork` mode the segment is excluded with (or 0)
+  struct mi_segment_s* fork_next;       // list of segments that are not excluded from a fork (see `segment.c:mi_segment_fork_track`)
+  struct mi_segment_s* fork_prev;
+
+  // summary of the free space while abandoned so reclaimers can skip non-matching segments (see `segment.c:mi_segment_abandoned_may_fit`)
+  _Atomic(uintptr_t) abandoned_bins[MI_BIN_MAP_SIZE]; // bit set for each bin that has a page with free blocks (or that received a concurrent free)
+  _Atomic(size_t)   abandoned_span;     // largest free span in slices (or the largest page that received a concurrent free)
 
   size_t            segment_slices;      // for huge segments this may be different from `MI_SLICES_PER_SEGMENT`
   size_t            segment_info_slices; // initial slices we are using segment info and possible guard pages.
@@ -414,11 +437,6 @@ typedef struct mi_page_queue_s {
   size_t     block_size;
 } mi_page_queue_t;
 
-typedef struct mi_detached_page_queue_s {
-  mi_page_t* first;
-  mi_page_t* last;
-} mi_detached_page_queue_t;
-
 #define MI_BIN_FULL  (MI_BIN_HUGE+1)
 
 // Random context
@@ -444,24 +462,38 @@ typedef struct mi_padding_s {
 
 #define MI_PAGES_DIRECT   (MI_SMALL_WSIZE_MAX + MI_PADDING_WSIZE + 1)
 
+// Per-bin retire state: the `score` tracks how often retired (empty) pages are
+// reused. A negative score frees empty pages right away, zero keeps only the
+// sole page of a bin, and a positive score keeps up to `score` empty pages.
+typedef struct mi_page_retire_s {
+  uint16_t              freed_beat;  // (truncated) heartbeat at which the last empty page of this bin was freed
+  int8_t                score;       // reuse score in `[-1,MI_RETIRE_KEEP_MAX]`
+  bool                  freed;       // `true` if `freed_beat` is valid
+  uint8_t               retired;     // number of retired pages (with `retire_expire != 0`) in the queue of this bin
+} mi_page_retire_t;
+
 
 // A heap owns a set of pages.
 struct mi_heap_s {
   mi_tld_t*             tld;
   mi_page_t*            pages_free_direct[MI_PAGES_DIRECT];  // optimize: array where every entry points a page with possibly free blocks in the corresponding queue for that size.
   mi_page_queue_t       pages[MI_BIN_FULL + 1];              // queue of pages for each size class (or "bin")
-  _Atomic(mi_block_t*)  thread_delayed_free;
+  _Atomic(mi_page_t*)   thread_delayed_pages;                // pages that received their first free from another thread (see `mi_free_block_mt`)
   mi_threadid_t         thread_id;                           // thread this heap belongs too
   uintptr_t             cookie;                              // random cookie to verify pointers (see `_mi_ptr_cookie`)
-  uintptr_t             keys[2];                             // two random keys used to encode the `thread_delayed_free` list
+  uintptr_t             keys[2];                             // two random keys (used to encode heap-level block lists)
   mi_random_ctx_t       random;                              // random number context used for secure allocation
   size_t                page_count;                          // total number of pages in the `pages` queues.
   size_t                page_retired_min;                    // smallest retired index (retired pages are fully free, but still in the page queues)
   size_t                page_retired_max;                    // largest retired index into the `pages` array.
+  mi_page_retire_t      page_retire[MI_BIN_HUGE];            // adaptive retire state for each size class
   mi_heap_t*            next;                                // list of heaps per thread
   mi_heap_t*            next_thread_heap;
   mi_heap_t*            prev_thread_heap;
   bool                  no_reclaim;                          // `true` if this heap should not reclaim abandoned pages
+  _Atomic(bool)         huge_lock;                           // protects the `MI_BIN_HUGE` queue as other threads can unlink huge pages from it
+  size_t                huge_pinned;                         // while non-zero other threads do not unlink huge pages (protected by `huge_lock`)
+  size_t                huge_freed;                          // huge pages unlinked by other threads that are still in `page_count` (protected by `huge_lock`)
 };
 
 
@@ -543,6 +575,7 @@ typedef struct mi_stats_s {
   mi_stat_counter_t mmap_calls;
   mi_stat_counter_t commit_calls;
   mi_stat_counter_t page_no_retire;
+  mi_stat_counter_t page_retire_hit;
   mi_stat_counter_t searches;
   mi_stat_counter_t normal_count;
   mi_stat_counter_t huge_count;
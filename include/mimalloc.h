@@ -131,7 +131,9 @@ mi_decl_nodiscard mi_decl_export void* mi_reallocn(void* p, size_t count, size_t
 mi_decl_nodiscard mi_decl_export void* mi_reallocf(void* p, size_t newsize)                   mi_attr_noexcept mi_attr_alloc_size(2);
 
 mi_decl_nodiscard mi_decl_export size_t mi_usable_size(const void* p) mi_attr_noexcept;
+mi_decl_export void mi_usable_size_batch(const void* const* ptrs, size_t count, size_t* sizes) mi_attr_noexcept;
 mi_decl_nodiscard mi_decl_export size_t mi_good_size(size_t size)     mi_attr_noexcept;
+mi_decl_nodiscard mi_decl_export void*  mi_realloc_growth(void* p, size_t min_needed, size_t* actual) mi_attr_noexcept;
 
 
 // ------------------------------------------------------
@@ -143,12 +145,30 @@ mi_decl_export void mi_lazy_process_load(void);
 typedef void (mi_cdecl mi_deferred_free_fun)(bool force, unsigned long long heartbeat, void* arg);
 mi_decl_export void mi_register_deferred_free(mi_deferred_free_fun* deferred_free, void* arg) mi_attr_noexcept;
 
+typedef struct mi_deferred_free_info_s {
+  bool               force;           // free all outstanding items
+  unsigned long long heartbeat;       // per-thread monotonically increasing count
+  long               budget_msecs;    // time budget for this call (0 if none)
+  size_t             committed;       // currently committed memory (in bytes)
+  size_t             peak_committed;  // peak committed memory (in bytes)
+  size_t             commit_limit;    // commit limit hint set by `mi_option_commit_limit` (in bytes, 0 if none)
+} mi_deferred_free_info_t;
+
+typedef void (mi_cdecl mi_deferred_free_ex_fun)(const mi_deferred_free_info_t* info, void* arg);
+mi_decl_export bool mi_register_deferred_free_ex(mi_deferred_free_ex_fun* deferred_free, void* arg, size_t frequency, long budget_msecs) mi_attr_noexcept;
+mi_decl_export void mi_unregister_deferred_free_ex(mi_deferred_free_ex_fun* deferred_free, void* arg) mi_attr_noexcept;
+
 typedef void (mi_cdecl mi_output_fun)(const char* msg, void* arg);
 mi_decl_export void mi_register_output(mi_output_fun* out, void* arg) mi_attr_noexcept;
 
 typedef void (mi_cdecl mi_error_fun)(int err, void* arg);
 mi_decl_export void mi_register_error(mi_error_fun* fun, void* arg);
 
+typedef void (mi_cdecl mi_alloc_hook_fun)(void* p, size_t size, void* arg);
+typedef void (mi_cdecl mi_free_hook_fun)(void* p, void* arg);
+typedef void (mi_cdecl mi_realloc_hook_fun)(void* p, void* newp, size_t newsize, void* arg);
+mi_decl_export void mi_register_hooks(mi_alloc_hook_fun* on_alloc, mi_free_hook_fun* on_free, mi_realloc_hook_fun* on_realloc, void* arg) mi_attr_noexcept;
+
 struct mallinfo {
   int arena;     /* Non-mmapped space allocated (bytes) */
   int ordblks;   /* Number of free chunks */
@@ -232,6 +252,7 @@ typedef struct mi_heap_s mi_heap_t;
 
 mi_decl_nodiscard mi_decl_export mi_heap_t* mi_heap_new(void);
 mi_decl_export void       mi_heap_delete(mi_heap_t* heap);
+mi_decl_export bool       mi_heap_adopt_page(mi_heap_t* heap, const void* p);
 mi_decl_export void       mi_heap_destroy(mi_heap_t* heap);
 mi_decl_export mi_heap_t* mi_heap_set_default(mi_heap_t* heap);
 mi_decl_export mi_heap_t* mi_heap_get_default(void);
@@ -247,6 +268,7 @@ mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_malloc_small(mi_
 mi_decl_nodiscard mi_decl_export void* mi_heap_realloc(mi_heap_t* heap, void* p, size_t newsize)              mi_attr_noexcept mi_attr_alloc_size(3);
 mi_decl_nodiscard mi_decl_export void* mi_heap_reallocn(mi_heap_t* heap, void* p, size_t count, size_t size)  mi_attr_noexcept mi_attr_alloc_size2(3,4);
 mi_decl_nodiscard mi_decl_export void* mi_heap_reallocf(mi_heap_t* heap, void* p, size_t newsize)             mi_attr_noexcept mi_attr_alloc_size(3);
+mi_decl_nodiscard mi_decl_export void* mi_heap_realloc_growth(mi_heap_t* heap, void* p, size_t min_needed, size_t* actual) mi_attr_noexcept;
 
 mi_decl_nodiscard mi_decl_export mi_decl_restrict char* mi_heap_strdup(mi_heap_t* heap, const char* s)            mi_attr_noexcept mi_attr_malloc;
 mi_decl_nodiscard mi_decl_export mi_decl_restrict char* mi_heap_strndup(mi_heap_t* heap, const char* s, size_t n) mi_attr_noexcept mi_attr_malloc;
@@ -293,6 +315,15 @@ mi_decl_nodiscard mi_decl_export void* mi_heap_recalloc_aligned_at(mi_heap_t* he
 mi_decl_export bool mi_heap_contains_block(mi_heap_t* heap, const void* p);
 mi_decl_export bool mi_heap_check_owned(mi_heap_t* heap, const void* p);
 mi_decl_export bool mi_check_owned(const void* p);
+
+typedef struct mi_ptr_info_s {
+  void*      block;       // start of the block containing the pointer (NULL if not a heap pointer)
+  size_t     block_size;  // usable size of the block (from its start)
+  mi_heap_t* heap;        // heap owning the block (NULL if the block is in an abandoned page)
+} mi_ptr_info_t;
+
+mi_decl_export void mi_block_info_batch(const void* const* ptrs, size_t count, mi_ptr_info_t* infos) mi_attr_noexcept;
+
 mi_decl_export int  mi_malloc_iterate(void* base, size_t size, void (*callback)(void* base, size_t size, void* arg), void* arg);
 mi_decl_export void mi_malloc_disable(void);
 mi_decl_export void mi_malloc_enable(void);
@@ -313,8 +344,20 @@ typedef bool (mi_cdecl mi_block_visit_fun)(const mi_heap_t* heap, const mi_heap_
 
 mi_decl_export bool mi_heap_visit_blocks(const mi_heap_t* heap, bool visit_all_blocks, mi_block_visit_fun* visitor, void* arg);
 
+typedef bool (mi_cdecl mi_block_predicate_fun)(const mi_heap_t* heap, void* block, size_t block_size, void* arg);
+
+mi_decl_export size_t mi_heap_free_if(mi_heap_t* heap, mi_block_predicate_fun* predicate, void* arg) mi_attr_noexcept;
+
+// Mark bits for garbage collectors
+mi_decl_export bool   mi_block_mark(const void* p) mi_attr_noexcept;
+mi_decl_export void   mi_block_unmark(const void* p) mi_attr_noexcept;
+mi_decl_nodiscard mi_decl_export bool mi_block_is_marked(const void* p) mi_attr_noexcept;
+mi_decl_export void   mi_heap_clear_marks(mi_heap_t* heap) mi_attr_noexcept;
+mi_decl_export size_t mi_heap_sweep_unmarked(mi_heap_t* heap) mi_attr_noexcept;
+
 // Experimental
 mi_decl_nodiscard mi_decl_export bool mi_is_in_heap_region(const void* p) mi_attr_noexcept;
+mi_decl_nodiscard mi_decl_export void* mi_block_start(const void* p, size_t* size) mi_attr_noexcept;
 mi_decl_nodiscard mi_decl_export bool mi_is_redirected(void) mi_attr_noexcept;
 
 mi_decl_export int mi_reserve_huge_os_pages_interleave(size_t pages, size_t numa_nodes, size_t timeout_msecs) mi_attr_noexcept;
@@ -381,6 +424,11 @@ typedef enum mi_option_e {
   mi_option_allow_decommit,
   mi_option_segment_decommit_delay,  
   mi_option_decommit_extend_delay,
+  mi_option_commit_limit,             // commit limit in MiB passed to deferred free functions as a hint; not enforced (0 = none)
+  mi_option_exclude_from_fork,        // 1 = do not copy segments into a forked child, 2 = zero them in the child
+  mi_option_arena_reserve,            // reserve address space N KiB at a time for segments (in an arena)
+  mi_option_reserve_address_space,    // reserve one heap space of N KiB at startup from which all segments are committed in place
+  mi_option_huge_cache_max,           // maximal total size in MiB of freed huge segments kept for reuse (0 = none)
   _mi_option_last
 } mi_option_t;
 
@@ -501,6 +549,30 @@ template<class T> struct mi_stl_allocator {
 
 template<class T1,class T2> bool operator==(const mi_stl_allocator<T1>& , const mi_stl_allocator<T2>& ) mi_attr_noexcept { return true; }
 template<class T1,class T2> bool operator!=(const mi_stl_allocator<T1>& , const mi_stl_allocator<T2>& ) mi_attr_noexcept { return false; }
+
+// ---------------------------------------------------------------------------------------------
+// Helpers for growing the buffers of vector or string-like containers.
+// ---------------------------------------------------------------------------------------------
+
+// The capacity (in elements) that fully uses the block that is allocated for `count` elements.
+template<class T> std::size_t mi_good_capacity(std::size_t count) mi_attr_noexcept {
+  if (count > PTRDIFF_MAX/sizeof(T)) return count;
+  return (mi_good_size(count*sizeof(T)) / sizeof(T));
+}
+
+// Grow the buffer `p` of trivially copyable elements to hold at least `needed` elements.
+// Returns the (possibly moved) buffer and sets `capacity` to its new capacity in elements.
+// Returns NULL on failure (in which case `p` and `capacity` are unchanged).
+template<class T> T* mi_grow_buffer(T* p, std::size_t needed, std::size_t& capacity) mi_attr_noexcept {
+  #if (__cplusplus >= 201103L) && (!defined(__GNUC__) || defined(__clang__) || (__GNUC__ >= 5))
+  static_assert(std::is_trivially_copyable<T>::value, "mi_grow_buffer can only move trivially copyable elements");
+  #endif
+  if (needed > PTRDIFF_MAX/sizeof(T)) return NULL;
+  std::size_t actual;
+  T* newp = static_cast<T*>(mi_realloc_growth(p, needed*sizeof(T), &actual));
+  if (newp != NULL) { capacity = actual / sizeof(T); }
+  return newp;
+}
 #endif // __cplusplus
 
 #endif
@@ -30,8 +30,11 @@ static mi_decl_noinline void* mi_heap_malloc_zero_aligned_at_fallback(mi_heap_t*
     return p;
   }
 
-  // otherwise over-allocate
+  // otherwise over-allocate (and report only the aligned block to the hooks)
+  const bool hooked = mi_hooks_installed();
+  if (hooked) { _mi_hooks_suspend(); }
   void* p = _mi_heap_malloc_zero(heap, size + alignment - 1, zero);
+  if (hooked) { _mi_hooks_resume(); }
   if (p == NULL) return NULL;
 
   // .. and align within the allocation
@@ -41,6 +44,7 @@ static mi_decl_noinline void* mi_heap_malloc_zero_aligned_at_fallback(mi_heap_t*
   if (aligned_p != p) mi_page_set_has_aligned(_mi_ptr_page(p), true);
   mi_assert_internal(((uintptr_t)aligned_p + offset) % alignment == 0);
   mi_assert_internal(p == _mi_page_ptr_unalign(_mi_ptr_segment(aligned_p), _mi_ptr_page(aligned_p), aligned_p));
+  if (hooked) { _mi_hook_alloc(aligned_p, size); }
   return aligned_p;
 }
 
@@ -83,6 +87,7 @@ static void* mi_heap_malloc_zero_aligned_at(mi_heap_t* const heap, const size_t
       mi_assert_internal(p != NULL);
       mi_assert_internal(((uintptr_t)p + offset) % alignment == 0);
       if (zero) { _mi_block_zero_init(page, p, size); }
+      if (mi_hooks_installed()) { _mi_hook_alloc(p, size); }
       return p;
     }
   }
@@ -169,7 +174,7 @@ mi_decl_restrict void* mi_calloc_aligned(size_t count, size_t size, size_t align
 // Aligned re-allocation
 // ------------------------------------------------------
 
-static void* mi_heap_realloc_zero_aligned_at(mi_heap_t* heap, void* p, size_t newsize, size_t alignment, size_t offset, bool zero) mi_attr_noexcept {
+static void* mi_heap_realloc_zero_aligned_at_unhooked(mi_heap_t* heap, void* p, size_t newsize, size_t alignment, size_t offset, bool zero) mi_attr_noexcept {
   mi_assert(alignment > 0);
   if (alignment <= sizeof(uintptr_t)) return _mi_heap_realloc_zero(heap,p,newsize,zero);
   if (p == NULL) return mi_heap_malloc_zero_aligned_at(heap,newsize,alignment,offset,zero);
@@ -178,6 +183,15 @@ static void* mi_heap_realloc_zero_aligned_at(mi_heap_t* heap, void* p, size_t ne
       && (((uintptr_t)p + offset) % alignment) == 0) {
     return p;  // reallocation still fits, is aligned and not more than 50% waste
   }
+  else if (size > MI_LARGE_BIN_OBJ_SIZE_MAX - MI_PADDING_SIZE && (((uintptr_t)p + offset) % alignment) == 0
+           && _mi_block_try_resize_in_place(p, newsize)) {
+    // grown or shrunk in place (which keeps the alignment)
+    if (zero && newsize > size) {
+      const size_t start = (size >= sizeof(intptr_t) ? size - sizeof(intptr_t) : 0);
+      memset((uint8_t*)p + start, 0, mi_usable_size(p) - start);
+    }
+    return p;
+  }
   else {
     void* newp = mi_heap_malloc_aligned_at(heap,newsize,alignment,offset);
     if (newp != NULL) {
@@ -193,13 +207,25 @@ static void* mi_heap_realloc_zero_aligned_at(mi_heap_t* heap, void* p, size_t ne
           memset((uint8_t*)newp + start, 0, newsize - start);
         }
       }
-      _mi_memcpy_aligned(newp, p, (newsize > size ? size : newsize));
+      _mi_memcpy_large(newp, p, (newsize > size ? size : newsize));
       mi_free(p); // only free if successful
     }
     return newp;
   }
 }
 
+static void* mi_heap_realloc_zero_aligned_at(mi_heap_t* heap, void* p, size_t newsize, size_t alignment, size_t offset, bool zero) mi_attr_noexcept {
+  if (mi_likely(!mi_hooks_installed())) {
+    return mi_heap_realloc_zero_aligned_at_unhooked(heap, p, newsize, alignment, offset, zero);
+  }
+  // report as a single reallocation instead of the internal allocation and free
+  _mi_hooks_suspend();
+  void* newp = mi_heap_realloc_zero_aligned_at_unhooked(heap, p, newsize, alignment, offset, zero);
+  _mi_hooks_resume();
+  _mi_hook_realloc(p, newp, newsize);
+  return newp;
+}
+
 static void* mi_heap_realloc_zero_aligned(mi_heap_t* heap, void* p, size_t newsize, size_t alignment, bool zero) mi_attr_noexcept {
   mi_assert(alignment > 0);
   if (alignment <= sizeof(uintptr_t)) return _mi_heap_realloc_zero(heap,p,newsize,zero);
@@ -72,10 +72,16 @@ mi_decl_nodiscard mi_decl_restrict void* mi_memalign(size_t alignment, size_t si
 }
 
 mi_decl_nodiscard mi_decl_restrict void* mi_valloc(size_t size) mi_attr_noexcept {
+  const bool hooked = mi_hooks_installed();  // report outside the lock as hooks may allocate
+  if (hooked) { _mi_hooks_suspend(); }
   bool locked = _mi_heap_lock_malloc();
   void* res =  mi_memalign( _mi_os_page_size(), size);
   if (mi_likely(locked))
     _mi_heap_unlock_malloc();
+  if (hooked) {
+    _mi_hooks_resume();
+    _mi_hook_alloc(res, size);
+  }
   return res;
 }
 
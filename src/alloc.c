@@ -23,6 +23,24 @@ terms of the MIT license. A copy of the license can be found in the file
 // Allocation
 // ------------------------------------------------------
 
+#if (MI_PADDING > 0) && defined(MI_ENCODE_FREELIST)
+// Set the padding after the usable block size; `size` includes `MI_PADDING_SIZE`
+static inline void mi_padding_init(const mi_page_t* page, mi_block_t* block, size_t size) {
+  mi_padding_t* const padding = (mi_padding_t*)((uint8_t*)block + mi_page_usable_block_size(page));
+  ptrdiff_t delta = ((uint8_t*)padding - (uint8_t*)block - (size - MI_PADDING_SIZE));
+  mi_assert_internal(delta >= 0 && mi_page_usable_block_size(page) >= (size - MI_PADDING_SIZE + delta));
+  padding->canary = (uint32_t)(mi_ptr_encode(page,block,page->keys));
+  padding->delta  = (uint32_t)(delta);
+  uint8_t* fill = (uint8_t*)padding - delta;
+  const size_t maxpad = (delta > MI_MAX_ALIGN_SIZE ? MI_MAX_ALIGN_SIZE : delta); // set at most N initial padding bytes
+  for (size_t i = 0; i < maxpad; i++) { fill[i] = MI_DEBUG_PADDING; }
+}
+#else
+static inline void mi_padding_init(const mi_page_t* page, mi_block_t* block, size_t size) {
+  MI_UNUSED(page); MI_UNUSED(block); MI_UNUSED(size);
+}
+#endif
+
 // Fast allocation in a page: just pop from the free list.
 // Fall back to generic allocation only if the list is empty.
 extern inline void* _mi_page_malloc(mi_heap_t* heap, mi_page_t* page, size_t size) mi_attr_noexcept {
@@ -36,6 +54,9 @@ extern inline void* _mi_page_malloc(mi_heap_t* heap, mi_page_t* page, size_t siz
   page->used++;
   page->free = mi_block_next(page, block);
   mi_assert_internal(page->free == NULL || _mi_ptr_page(page->free) == page);
+  #if MI_LIVE_BITS
+  mi_block_set_live(block);
+  #endif
 
 #if (MI_DEBUG>0)
   if (!page->is_zero) { memset(block, MI_DEBUG_UNINIT, size); }
@@ -53,24 +74,19 @@ extern inline void* _mi_page_malloc(mi_heap_t* heap, mi_page_t* page, size_t siz
     mi_heap_stat_increase(heap, normal_bins[bin], 1);
 #endif
   }
+  else if (page->xblock_size <= MI_LARGE_BIN_OBJ_SIZE_MAX) {
+    // large objects in a size class (others are counted in `page.c:mi_large_huge_page_alloc`)
+    mi_heap_stat_increase(heap, large, bsize);
+    mi_heap_stat_counter_increase(heap, large_count, 1);
+  }
 #endif
 
-#if (MI_PADDING > 0) && defined(MI_ENCODE_FREELIST)
-  mi_padding_t* const padding = (mi_padding_t*)((uint8_t*)block + mi_page_usable_block_size(page));
-  ptrdiff_t delta = ((uint8_t*)padding - (uint8_t*)block - (size - MI_PADDING_SIZE));
-  mi_assert_internal(delta >= 0 && mi_page_usable_block_size(page) >= (size - MI_PADDING_SIZE + delta));
-  padding->canary = (uint32_t)(mi_ptr_encode(page,block,page->keys));
-  padding->delta  = (uint32_t)(delta);
-  uint8_t* fill = (uint8_t*)padding - delta;
-  const size_t maxpad = (delta > MI_MAX_ALIGN_SIZE ? MI_MAX_ALIGN_SIZE : delta); // set at most N initial padding bytes
-  for (size_t i = 0; i < maxpad; i++) { fill[i] = MI_DEBUG_PADDING; }
-#endif
-
+  mi_padding_init(page, block, size);
   return block;
 }
 
 // allocate a small block
-extern inline mi_decl_restrict void* mi_heap_malloc_small(mi_heap_t* heap, size_t size) mi_attr_noexcept {
+static inline mi_decl_restrict void* mi_heap_malloc_small_unhooked(mi_heap_t* heap, size_t size) mi_attr_noexcept {
   mi_assert(heap!=NULL);
   mi_assert(heap->thread_id == 0 || heap->thread_id == _mi_thread_id()); // heaps are thread local
   mi_assert(size <= MI_SMALL_SIZE_MAX);
@@ -91,14 +107,20 @@ extern inline mi_decl_restrict void* mi_heap_malloc_small(mi_heap_t* heap, size_
   return p;
 }
 
+extern inline mi_decl_restrict void* mi_heap_malloc_small(mi_heap_t* heap, size_t size) mi_attr_noexcept {
+  void* p = mi_heap_malloc_small_unhooked(heap, size);
+  if (mi_hooks_installed()) { _mi_hook_alloc(p, size); }
+  return p;
+}
+
 extern inline mi_decl_restrict void* mi_malloc_small(size_t size) mi_attr_noexcept {
   return mi_heap_malloc_small(mi_get_default_heap(), size);
 }
 
 // The main allocation function
-extern inline mi_decl_restrict void* mi_heap_malloc(mi_heap_t* heap, size_t size) mi_attr_noexcept {
+static inline mi_decl_restrict void* mi_heap_malloc_unhooked(mi_heap_t* heap, size_t size) mi_attr_noexcept {
   if (mi_likely(size <= MI_SMALL_SIZE_MAX)) {
-    return mi_heap_malloc_small(heap, size);
+    return mi_heap_malloc_small_unhooked(heap, size);
   }
   else {
     mi_assert(heap!=NULL);
@@ -115,12 +137,19 @@ extern inline mi_decl_restrict void* mi_heap_malloc(mi_heap_t* heap, size_t size
   }
 }
 
+extern inline mi_decl_restrict void* mi_heap_malloc(mi_heap_t* heap, size_t size) mi_attr_noexcept {
+  void* p = mi_heap_malloc_unhooked(heap, size);
+  if (mi_hooks_installed()) { _mi_hook_alloc(p, size); }
+  return p;
+}
+
 extern inline mi_decl_restrict void* mi_malloc(size_t size) mi_attr_noexcept {
   mi_lazy_process_load();
   bool locked = _mi_heap_lock_malloc();
-  void* res = mi_heap_malloc(mi_get_default_heap(), size);
+  void* res = mi_heap_malloc_unhooked(mi_get_default_heap(), size);
   if (mi_likely(locked))
     _mi_heap_unlock_malloc();
+  if (mi_hooks_installed()) { _mi_hook_alloc(res, size); }  // outside the lock as hooks may allocate
   return res;
 }
 
@@ -216,6 +245,20 @@ static inline bool mi_check_is_double_free(const mi_page_t* page, const mi_block
 }
 #endif
 
+#if MI_LIVE_BITS
+// Clear the live bit of a block freed by the owning thread (which also detects a double free)
+static inline bool mi_block_check_live(const mi_block_t* block) {
+  if (mi_likely(mi_block_clear_live(block))) return true;
+  _mi_error_message(EAGAIN, "double free detected of block %p\n", block);
+  return false;
+}
+#else
+static inline bool mi_block_check_live(const mi_block_t* block) {
+  MI_UNUSED(block);
+  return true;
+}
+#endif
+
 // ---------------------------------------------------------------------------
 // Check for heap block overflow by setting up padding at the end of the block
 // ---------------------------------------------------------------------------
@@ -301,7 +344,7 @@ static void mi_padding_shrink(const mi_page_t* page, const mi_block_t* block, co
 
 // only maintain stats for smaller objects if requested
 #if (MI_STAT>0)
-static void mi_stat_free(const mi_page_t* page, const mi_block_t* block) {
+void _mi_stat_free(const mi_page_t* page, const mi_block_t* block) {
   #if (MI_STAT < 2)  
   MI_UNUSED(block);
   #endif
@@ -325,29 +368,11 @@ static void mi_stat_free(const mi_page_t* page, const mi_block_t* block) {
   }
 }
 #else
-static void mi_stat_free(const mi_page_t* page, const mi_block_t* block) {
+void _mi_stat_free(const mi_page_t* page, const mi_block_t* block) {
   MI_UNUSED(page); MI_UNUSED(block);
 }
 #endif
 
-#if (MI_STAT>0)
-// maintain stats for huge objects
-static void mi_stat_huge_free(const mi_page_t* page) {
-  mi_heap_t* const heap = mi_heap_get_default();
-  const size_t bsize = mi_page_block_size(page); // to match stats in `page.c:mi_page_huge_alloc`
-  if (bsize <= MI_LARGE_OBJ_SIZE_MAX) {
-    mi_heap_stat_decrease(heap, large, bsize);
-  }
-  else {
-    mi_heap_stat_decrease(heap, huge, bsize);
-  }
-}
-#else
-static void mi_stat_huge_free(const mi_page_t* page) {
-  MI_UNUSED(page);
-}
-#endif
-
 // ------------------------------------------------------
 // Free
 // ------------------------------------------------------
@@ -363,29 +388,30 @@ static mi_decl_noinline void _mi_free_block_mt(mi_page_t* page, mi_block_t* bloc
   memset(block, MI_DEBUG_FREED, mi_usable_size(block));
   #endif
 
-  // huge page segments are always abandoned and can be freed immediately
-  mi_segment_t* segment = _mi_page_segment(page);
+  // huge pages occupy the entire segment: free it right away if possible,
+  // and otherwise reset the memory until the owning heap frees the page
+  mi_segment_t* const segment = _mi_page_segment(page);
   if (segment->kind==MI_SEGMENT_HUGE) {
-    mi_stat_huge_free(page);
-    _mi_page_remove_detached_page(page);
-    _mi_segment_huge_page_free(segment, page, block);
-    return;
+    if (_mi_segment_huge_page_free(segment, page, block)) return;
+    _mi_segment_huge_page_reset(segment, page, block);
+  }
+  if (mi_unlikely(mi_atomic_load_relaxed(&segment->thread_id) == 0)) {
+    // the segment is abandoned: note the free in its summary so a reclaiming thread will look at it
+    _mi_segment_abandoned_page_free(segment, page);
   }
 
-  // Try to put the block on either the page-local thread free list, or the heap delayed free list.
+  // Always put the block on the page-local thread free list so it is available as soon as
+  // the owner collects the page; the first such free also notifies the owning heap.
   mi_thread_free_t tfreex;
   bool use_delayed;
   mi_thread_free_t tfree = mi_atomic_load_relaxed(&page->xthread_free);
   do {
     use_delayed = (mi_tf_delayed(tfree) == MI_USE_DELAYED_FREE);
+    mi_block_set_next(page, block, mi_tf_block(tfree));
+    tfreex = mi_tf_set_block(tfree,block);
     if (mi_unlikely(use_delayed)) {
-      // unlikely: this only happens on the first concurrent free in a page that is in the full list
-      tfreex = mi_tf_set_delayed(tfree,MI_DELAYED_FREEING);
-    }
-    else {
-      // usual: directly add to page thread_free list
-      mi_block_set_next(page, block, mi_tf_block(tfree));
-      tfreex = mi_tf_set_block(tfree,block);
+      // unlikely: this only happens on the first concurrent free since the owner last processed this page
+      tfreex = mi_tf_set_delayed(tfreex,MI_DELAYED_FREEING);
     }
   } while (!mi_atomic_cas_weak_release(&page->xthread_free, &tfree, tfreex));
 
@@ -394,11 +420,11 @@ static mi_decl_noinline void _mi_free_block_mt(mi_page_t* page, mi_block_t* bloc
     mi_heap_t* const heap = (mi_heap_t*)(mi_atomic_load_acquire(&page->xheap)); //mi_page_heap(page);
     mi_assert_internal(heap != NULL);
     if (heap != NULL) {
-      // add to the delayed free list of this heap. (do this atomically as the lock only protects heap memory validity)
-      mi_block_t* dfree = mi_atomic_load_ptr_relaxed(mi_block_t, &heap->thread_delayed_free);
+      // push the page on the delayed list of this heap. (do this atomically as the lock only protects heap memory validity)
+      mi_page_t* dpage = mi_atomic_load_ptr_relaxed(mi_page_t, &heap->thread_delayed_pages);
       do {
-        mi_block_set_nextx(heap,block,dfree, heap->keys);
-      } while (!mi_atomic_cas_ptr_weak_release(mi_block_t,&heap->thread_delayed_free, &dfree, block));
+        page->delayed_next = dpage;
+      } while (!mi_atomic_cas_ptr_weak_release(mi_page_t,&heap->thread_delayed_pages, &dpage, page));
     }
 
     // and reset the MI_DELAYED_FREEING flag
@@ -418,6 +444,7 @@ static inline void _mi_free_block(mi_page_t* page, bool local, mi_block_t* block
   if (mi_likely(local)) {
     // owning thread can free a block directly
     if (mi_unlikely(mi_check_is_double_free(page, block))) return;
+    if (mi_unlikely(!mi_block_check_live(block))) return;
     mi_check_padding(page, block);
     #if (MI_DEBUG!=0)
     memset(block, MI_DEBUG_FREED, mi_page_block_size(page));
@@ -450,7 +477,7 @@ mi_block_t* _mi_page_ptr_unalign(const mi_segment_t* segment, const mi_page_t* p
 static void mi_decl_noinline mi_free_generic(const mi_segment_t* segment, bool local, void* p) mi_attr_noexcept {
   mi_page_t* const page = _mi_segment_page_of(segment, p);
   mi_block_t* const block = (mi_page_has_aligned(page) ? _mi_page_ptr_unalign(segment, page, p) : (mi_block_t*)p);
-  mi_stat_free(page, block);
+  _mi_stat_free(page, block);
   _mi_free_block(page, local, block);
 }
 
@@ -501,8 +528,9 @@ void mi_free_internal(void* p) mi_attr_noexcept
     // local, and not full or aligned
     mi_block_t* block = (mi_block_t*)(p);
     if (mi_unlikely(mi_check_is_double_free(page,block))) return;
+    if (mi_unlikely(!mi_block_check_live(block))) return;
     mi_check_padding(page, block);
-    mi_stat_free(page, block);
+    _mi_stat_free(page, block);
     #if (MI_DEBUG!=0)
     memset(block, MI_DEBUG_FREED, mi_page_block_size(page));
     #endif
@@ -521,34 +549,13 @@ void mi_free_internal(void* p) mi_attr_noexcept
 
 void mi_free(void* p) mi_attr_noexcept
 {
+  if (mi_hooks_installed()) { _mi_hook_free(p); }
   bool locked = _mi_heap_lock_malloc();
   mi_free_internal(p);
   if (mi_likely(locked))
     _mi_heap_unlock_malloc();
 }
 
-bool _mi_free_delayed_block(mi_block_t* block) {
-  // get segment and page
-  const mi_segment_t* const segment = _mi_ptr_segment(block);
-  mi_assert_internal(_mi_ptr_cookie(segment) == segment->cookie);
-  mi_assert_internal(_mi_thread_id() == segment->thread_id);
-  mi_page_t* const page = _mi_segment_page_of(segment, block);
-
-  // Clear the no-delayed flag so delayed freeing is used again for this page.
-  // This must be done before collecting the free lists on this page -- otherwise
-  // some blocks may end up in the page `thread_free` list with no blocks in the
-  // heap `thread_delayed_free` list which may cause the page to be never freed!
-  // (it would only be freed if we happen to scan it in `mi_page_queue_find_free_ex`)
-  _mi_page_use_delayed_free(page, MI_USE_DELAYED_FREE, false /* dont overwrite never delayed */);
-
-  // collect all other non-local frees to ensure up-to-date `used` count
-  _mi_page_free_collect(page, false);
-
-  // and free the block (possibly freeing the page as well since used is updated)
-  _mi_free_block(page, true, block);
-  return true;
-}
-
 // Bytes available in a block
 mi_decl_noinline static size_t mi_page_usable_aligned_size_of(const mi_segment_t* segment, const mi_page_t* page, const void* p) mi_attr_noexcept {
   const mi_block_t* block = _mi_page_ptr_unalign(segment, page, p);
@@ -577,6 +584,98 @@ size_t mi_usable_size(const void* p) mi_attr_noexcept {
 }
 
 
+// ------------------------------------------------------
+// Batched queries: consecutive pointers into the same page
+// (as in a sorted batch) share the segment and page lookup.
+// ------------------------------------------------------
+
+typedef struct mi_batch_page_s {
+  const mi_segment_t* segment;
+  const mi_page_t*    page;
+  const uint8_t*      start;  // page area of the last looked up page
+  const uint8_t*      end;
+} mi_batch_page_t;
+
+// Returns NULL if `p` does not point into the area of a page (as in `mi_block_start`).
+static inline const mi_page_t* mi_batch_page_of(const void* p, mi_batch_page_t* last) {
+  if ((const uint8_t*)p >= last->start && (const uint8_t*)p < last->end) return last->page;
+  const mi_segment_t* const segment = _mi_segment_of(p);
+  if (segment == NULL) return NULL;  // also if `p == NULL` or not allocated by us
+  const mi_page_t* const page = (segment->kind == MI_SEGMENT_HUGE
+                                  ? mi_slice_to_page((mi_slice_t*)&segment->slices[segment->segment_info_slices])  // `p` may be beyond the first MI_SEGMENT_SIZE
+                                  : _mi_segment_page_of(segment, p));
+  if (page->xblock_size == 0) return NULL;  // free span
+  size_t psize;
+  const uint8_t* const start = _mi_page_start(segment, page, &psize);
+  if ((const uint8_t*)p < start || (const uint8_t*)p >= start + psize) return NULL;  // segment info
+  last->segment = segment;
+  last->page = page;
+  last->start = start;
+  last->end = start + psize;
+  return page;
+}
+
+void mi_usable_size_batch(const void* const* ptrs, size_t count, size_t* sizes) mi_attr_noexcept {
+  mi_batch_page_t last = { NULL, NULL, NULL, NULL };
+  for (size_t i = 0; i < count; i++) {
+    const void* const p = ptrs[i];
+    const mi_page_t* const page = mi_batch_page_of(p, &last);
+    if (page == NULL) {
+      sizes[i] = 0;
+    }
+    else if (mi_likely(!mi_page_has_aligned(page))) {
+      sizes[i] = mi_page_usable_size_of(page, (const mi_block_t*)p);
+    }
+    else {
+      sizes[i] = mi_page_usable_aligned_size_of(last.segment, page, p);
+    }
+  }
+}
+
+void mi_block_info_batch(const void* const* ptrs, size_t count, mi_ptr_info_t* infos) mi_attr_noexcept {
+  mi_batch_page_t last = { NULL, NULL, NULL, NULL };
+  for (size_t i = 0; i < count; i++) {
+    const void* const p = ptrs[i];
+    mi_ptr_info_t* const info = &infos[i];
+    const mi_page_t* const page = mi_batch_page_of(p, &last);
+    if (page == NULL) {
+      info->block = NULL;
+      info->block_size = 0;
+      info->heap = NULL;
+    }
+    else {
+      mi_block_t* const block = _mi_page_ptr_unalign(last.segment, page, p);
+      info->block = block;
+      info->block_size = mi_page_usable_size_of(page, block);
+      info->heap = mi_page_heap(page);
+    }
+  }
+}
+
+// Find the block containing any pointer `p` (or NULL if `p` is not in an allocated area of a page).
+// Uses the segment map so `p` does not need to point into our heap.
+void* mi_block_start(const void* p, size_t* size) mi_attr_noexcept {
+  if (size != NULL) *size = 0;
+  const mi_segment_t* const segment = _mi_segment_of(p);
+  if (segment == NULL) return NULL;
+  const mi_page_t* const page = (segment->kind == MI_SEGMENT_HUGE
+                                  ? mi_slice_to_page((mi_slice_t*)&segment->slices[segment->segment_info_slices])  // `p` may be beyond the first MI_SEGMENT_SIZE
+                                  : _mi_segment_page_of(segment, p));
+  if (page->xblock_size == 0 || page->used == 0) return NULL;  // free span, segment info, or empty page
+  size_t psize;
+  uint8_t* const start = _mi_page_start(segment, page, &psize);
+  if ((const uint8_t*)p < start) return NULL;
+  const size_t bsize = mi_page_block_size(page);
+  const size_t idx = ((size_t)((const uint8_t*)p - start)) / bsize;
+  if (idx >= page->capacity) return NULL;  // never allocated
+  #if MI_LIVE_BITS
+  if (!mi_block_is_live(start + idx*bsize)) return NULL;
+  #endif
+  if (size != NULL) *size = mi_page_usable_block_size(page);
+  return (start + idx*bsize);
+}
+
+
 // ------------------------------------------------------
 // ensure explicit external inline definitions are emitted!
 // ------------------------------------------------------
@@ -624,10 +723,16 @@ extern inline mi_decl_restrict void* mi_heap_calloc(mi_heap_t* heap, size_t coun
 
 mi_decl_restrict void* mi_calloc(size_t count, size_t size) mi_attr_noexcept {
   mi_lazy_process_load();
+  const bool hooked = mi_hooks_installed();  // report outside the lock as hooks may allocate
+  if (hooked) { _mi_hooks_suspend(); }
   bool locked = _mi_heap_lock_malloc();
   void* res = mi_heap_calloc(mi_get_default_heap(),count,size);
   if (mi_likely(locked))
     _mi_heap_unlock_malloc();
+  if (hooked) {
+    _mi_hooks_resume();
+    _mi_hook_alloc(res, count*size);  // no overflow if res != NULL
+  }
   return res;
 }
 
@@ -651,33 +756,99 @@ void* mi_expand(void* p, size_t newsize) mi_attr_noexcept {
   #else
   if (p == NULL) return NULL;
   const size_t size = _mi_usable_size(p,"mi_expand");
-  if (newsize > size) return NULL;
+  if (newsize > size) {
+    // large blocks in a page of their own can sometimes grow in place
+    if (size <= MI_LARGE_BIN_OBJ_SIZE_MAX || !_mi_block_try_resize_in_place(p, newsize)) return NULL;
+    if (mi_hooks_installed()) { _mi_hook_realloc(p, p, newsize); }
+  }
   return p; // it fits
   #endif
 }
 
-void* _mi_heap_realloc_zero(mi_heap_t* heap, void* p, size_t newsize, bool zero) mi_attr_noexcept {
+// Resize a large block that has a page of its own in place, by growing or shrinking
+// its page into the adjacent slices of the segment (see `segment.c`). Only for the
+// owning thread; blocks in shared pages or huge segments are never resized.
+bool _mi_block_try_resize_in_place(void* p, size_t newsize) {
+  mi_segment_t* const segment = _mi_ptr_segment(p);
+  if (segment->kind == MI_SEGMENT_HUGE || mi_atomic_load_relaxed(&segment->thread_id) != _mi_thread_id()) return false;
+  mi_page_t* const page = _mi_segment_page_of(segment, p);
+  const size_t bsize = mi_page_block_size(page);
+  if (bsize <= MI_LARGE_BIN_OBJ_SIZE_MAX || page->reserved != 1 || mi_page_has_aligned(page)) return false;
+  if (newsize > MI_LARGE_OBJ_SIZE_MAX - MI_PADDING_SIZE) return false;
+  const size_t new_bsize = _mi_align_up(newsize + MI_PADDING_SIZE, MI_SEGMENT_SLICE_SIZE);
+  if (new_bsize <= MI_LARGE_BIN_OBJ_SIZE_MAX) return false;  // smaller blocks live in shared pages
+  mi_assert_internal(page->used == 1 && p == _mi_page_start(segment, page, NULL));
+  mi_heap_t* const heap = mi_page_heap(page);
+  #if (MI_STAT>1)
+  mi_heap_stat_decrease(heap, malloc, mi_usable_size(p));
+  #endif
+  if (!_mi_segment_page_try_resize(page, new_bsize, &heap->tld->segments)) {
+    #if (MI_STAT>1)
+    mi_heap_stat_increase(heap, malloc, mi_usable_size(p));
+    #endif
+    return false;
+  }
+  mi_padding_init(page, (mi_block_t*)p, newsize + MI_PADDING_SIZE);
+  #if (MI_STAT>0)
+  mi_heap_stat_decrease(heap, large, bsize - MI_PADDING_SIZE);
+  mi_heap_stat_increase(heap, large, new_bsize - MI_PADDING_SIZE);
+  #endif
+  #if (MI_STAT>1)
+  mi_heap_stat_increase(heap, malloc, mi_usable_size(p));
+  #endif
+  mi_assert_internal(mi_usable_size(p) >= newsize);
+  return true;
+}
+
+static void* mi_heap_realloc_zero_unhooked(mi_heap_t* heap, void* p, size_t newsize, bool zero) mi_attr_noexcept {
   mi_lazy_process_load();
   const size_t size = _mi_usable_size(p,"mi_realloc"); // also works if p == NULL
   if (mi_unlikely(newsize <= size && newsize >= (size / 2))) {
     // todo: adjust potential padding to reflect the new size?
     return p;  // reallocation still fits and not more than 50% waste
   }
+  // the block moves: if it must move into another heap (as in `mi_heap_realloc(heap,...)` but
+  // not for the default heap, as in `mi_realloc`), a large block of this thread is usually alone
+  // in its page so we can take over the page and resize in place instead of copying
+  const bool in_place = (size > MI_LARGE_BIN_OBJ_SIZE_MAX - MI_PADDING_SIZE &&
+                         (heap == mi_get_default_heap() || mi_heap_adopt_page(heap, p)));
+  if (in_place && _mi_block_try_resize_in_place(p, newsize)) {
+    // grown or shrunk in place without copying
+    if (zero && newsize > size) {
+      // zero up to the new usable size so a later `mi_rezalloc` can expand in place as well
+      const size_t start = (size >= sizeof(intptr_t) ? size - sizeof(intptr_t) : 0);
+      memset((uint8_t*)p + start, 0, mi_usable_size(p) - start);
+    }
+    return p;
+  }
   void* newp = mi_heap_malloc(heap,newsize);
   if (mi_likely(newp != NULL)) {
     if (zero && newsize > size) {
-      // also set last word in the previous allocation to zero to ensure any padding is zero-initialized
+      // also set last word in the previous allocation to zero to ensure any padding is zero-initialized,
+      // and zero up to the usable size so a later `mi_rezalloc` can expand in place
       const size_t start = (size >= sizeof(intptr_t) ? size - sizeof(intptr_t) : 0);
-      memset((uint8_t*)newp + start, 0, newsize - start);
+      memset((uint8_t*)newp + start, 0, mi_usable_size(newp) - start);
     }
     if (mi_likely(p != NULL)) {
-      _mi_memcpy_aligned(newp, p, (newsize > size ? size : newsize));
+      _mi_memcpy_large(newp, p, (newsize > size ? size : newsize));
       mi_free(p); // only free the original pointer if successful
     }
   }
   return newp;
 }
 
+void* _mi_heap_realloc_zero(mi_heap_t* heap, void* p, size_t newsize, bool zero) mi_attr_noexcept {
+  if (mi_likely(!mi_hooks_installed())) {
+    return mi_heap_realloc_zero_unhooked(heap, p, newsize, zero);
+  }
+  // report as a single reallocation instead of the internal allocation and free
+  _mi_hooks_suspend();
+  void* newp = mi_heap_realloc_zero_unhooked(heap, p, newsize, zero);
+  _mi_hooks_resume();
+  _mi_hook_realloc(p, newp, newsize);
+  return newp;
+}
+
 void* mi_heap_realloc(mi_heap_t* heap, void* p, size_t newsize) mi_attr_noexcept {
   return _mi_heap_realloc_zero(heap, p, newsize, false);  
 }
@@ -696,6 +867,32 @@ void* mi_heap_reallocf(mi_heap_t* heap, void* p, size_t newsize) mi_attr_noexcep
   return newp;
 }
 
+// Grow `p` to at least `min_needed` bytes for a growing buffer; grows geometrically
+// (by 1.5x) to the full size class, prefers expanding in place, and returns the
+// new usable size in `actual`.
+void* mi_heap_realloc_growth(mi_heap_t* heap, void* p, size_t min_needed, size_t* actual) mi_attr_noexcept {
+  const size_t size = (p == NULL ? 0 : mi_usable_size(p));
+  if (mi_unlikely(min_needed > PTRDIFF_MAX)) {
+    _mi_error_message(EOVERFLOW, "allocation request is too large (%zu bytes)\n", min_needed);
+    if (actual != NULL) { *actual = size; }
+    return NULL;
+  }
+  void* newp = p;
+  if (min_needed > size) {
+    size_t target = size + (size / 2);
+    if (target < min_needed || target > PTRDIFF_MAX) { target = min_needed; }
+    target = mi_good_size(target);
+    if (p == NULL || (mi_expand(p, target) == NULL && (target == min_needed || mi_expand(p, min_needed) == NULL))) {
+      newp = mi_heap_realloc(heap, p, target);
+      if (newp == NULL && target > min_needed) {
+        newp = mi_heap_realloc(heap, p, min_needed);
+      }
+    }
+  }
+  if (actual != NULL) { *actual = (newp == NULL ? size : mi_usable_size(newp)); }
+  return newp;
+}
+
 void* mi_heap_rezalloc(mi_heap_t* heap, void* p, size_t newsize) mi_attr_noexcept {
   return _mi_heap_realloc_zero(heap, p, newsize, true);
 }
@@ -720,6 +917,10 @@ void* mi_reallocf(void* p, size_t newsize) mi_attr_noexcept {
   return mi_heap_reallocf(mi_get_default_heap(),p,newsize);
 }
 
+void* mi_realloc_growth(void* p, size_t min_needed, size_t* actual) mi_attr_noexcept {
+  return mi_heap_realloc_growth(mi_get_default_heap(), p, min_needed, actual);
+}
+
 void* mi_rezalloc(void* p, size_t newsize) mi_attr_noexcept {
   return mi_heap_rezalloc(mi_get_default_heap(), p, newsize);
 }
@@ -730,6 +931,80 @@ void* mi_recalloc(void* p, size_t count, size_t size) mi_attr_noexcept {
 
 
 
+// ------------------------------------------------------
+// Allocation hooks
+// Hooks are called after a successful allocation or reallocation,
+// and before a block is freed. Allocations and frees done while
+// running a hook (or inside a reallocation) are not reported which
+// allows hooks to allocate themselves.
+// ------------------------------------------------------
+
+_Atomic(bool) _mi_hooks_installed; // = false
+
+static _Atomic(mi_alloc_hook_fun*)   mi_hook_on_alloc;    // = NULL
+static _Atomic(mi_free_hook_fun*)    mi_hook_on_free;     // = NULL
+static _Atomic(mi_realloc_hook_fun*) mi_hook_on_realloc;  // = NULL
+static _Atomic(void*)                mi_hook_arg;         // = NULL
+
+static mi_decl_thread size_t mi_hooks_suspended;  // > 0 while running a hook or a composite operation
+
+void _mi_hooks_suspend(void) {
+  mi_hooks_suspended++;
+}
+
+void _mi_hooks_resume(void) {
+  mi_assert_internal(mi_hooks_suspended > 0);
+  mi_hooks_suspended--;
+}
+
+void _mi_hook_alloc(void* p, size_t size) {
+  if (p == NULL || mi_hooks_suspended > 0) return;
+  mi_alloc_hook_fun* on_alloc = mi_atomic_load_ptr_acquire(mi_alloc_hook_fun, &mi_hook_on_alloc);
+  if (on_alloc == NULL) return;
+  mi_hooks_suspended++;
+  on_alloc(p, size, mi_atomic_load_ptr_relaxed(void, &mi_hook_arg));
+  mi_hooks_suspended--;
+}
+
+void _mi_hook_free(void* p) {
+  if (p == NULL || mi_hooks_suspended > 0) return;
+  mi_free_hook_fun* on_free = mi_atomic_load_ptr_acquire(mi_free_hook_fun, &mi_hook_on_free);
+  if (on_free == NULL) return;
+  mi_hooks_suspended++;
+  on_free(p, mi_atomic_load_ptr_relaxed(void, &mi_hook_arg));
+  mi_hooks_suspended--;
+}
+
+void _mi_hook_realloc(void* p, void* newp, size_t newsize) {
+  if (newp == NULL || mi_hooks_suspended > 0) return;  // on failure the original block is unchanged
+  if (p == NULL) {
+    _mi_hook_alloc(newp, newsize);
+    return;
+  }
+  mi_realloc_hook_fun* on_realloc = mi_atomic_load_ptr_acquire(mi_realloc_hook_fun, &mi_hook_on_realloc);
+  if (on_realloc == NULL) {
+    // report as a free followed by an allocation
+    _mi_hook_free(p);
+    _mi_hook_alloc(newp, newsize);
+    return;
+  }
+  mi_hooks_suspended++;
+  on_realloc(p, newp, newsize, mi_atomic_load_ptr_relaxed(void, &mi_hook_arg));
+  mi_hooks_suspended--;
+}
+
+void mi_register_hooks(mi_alloc_hook_fun* on_alloc, mi_free_hook_fun* on_free, mi_realloc_hook_fun* on_realloc, void* arg) mi_attr_noexcept {
+  mi_atomic_store_release(&_mi_hooks_installed, false);
+  mi_atomic_store_ptr_release(void, &mi_hook_arg, arg);
+  mi_atomic_store_ptr_release(mi_alloc_hook_fun, &mi_hook_on_alloc, on_alloc);
+  mi_atomic_store_ptr_release(mi_free_hook_fun, &mi_hook_on_free, on_free);
+  mi_atomic_store_ptr_release(mi_realloc_hook_fun, &mi_hook_on_realloc, on_realloc);
+  if (on_alloc != NULL || on_free != NULL || on_realloc != NULL) {
+    mi_atomic_store_release(&_mi_hooks_installed, true);
+  }
+}
+
+
 // ------------------------------------------------------
 // strdup, strndup, and realpath
 // ------------------------------------------------------
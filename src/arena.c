@@ -11,8 +11,11 @@ large blocks (>= MI_ARENA_MIN_BLOCK_SIZE, 4MiB).
 In contrast to the rest of mimalloc, the arenas are shared between
 threads and need to be accessed using atomic operations.
 
-Currently arenas are only used to for huge OS page (1GiB) reservations,
-or direct OS memory reservations -- otherwise it delegates to direct allocation from the OS.
+Arenas are used for huge OS page (1GiB) reservations, direct OS memory
+reservations, and for address space that is reserved on demand (`mi_option_arena_reserve`).
+The latter is reserved (but not committed) a GiB at a time so segments are committed
+in place and freed blocks are reused without going back to the OS. Only when no arena
+can be reserved do we delegate to direct allocation from the OS.
 In the future, we can expose an API to manually add more kinds of arenas
 which is sometimes needed for embedded devices or shared memory for example.
 (We can also employ this with WASI or `sbrk` systems to reserve large arenas
@@ -26,6 +29,7 @@ The arena allocation needs to be thread safe and we use an atomic bitmap to allo
 
 #include <string.h>  // memset
 #include <errno.h> // ENOMEM
+#include <limits.h> // LONG_MAX
 
 #include "bitmap.h"  // atomic bitmap
 
@@ -191,6 +195,22 @@ static mi_decl_noinline void* mi_arena_allocate(int numa_node, size_t size, size
 }
 
 
+// Reserve a new arena on demand (of `mi_option_arena_reserve` KiB) that can hold at least `req_size` bytes.
+// The arena is not committed so this only takes address space.
+static bool mi_arena_reserve(size_t req_size, bool allow_large) {
+  if (_mi_preloading()) return false;  // use the OS only while preloading
+  const size_t arena_count = mi_atomic_load_acquire(&mi_arena_count);
+  if (arena_count > (MI_MAX_ARENAS - 4)) return false;  // leave some room for explicit reservations
+  size_t arena_reserve = (size_t)mi_option_get_clamp(mi_option_arena_reserve, 0, LONG_MAX / MI_KiB) * MI_KiB;
+  if (arena_reserve == 0) return false;
+  arena_reserve = _mi_align_up(arena_reserve, MI_ARENA_BLOCK_SIZE);
+  if (arena_count >= 8 && arena_count <= 128) {
+    arena_reserve = ((size_t)1 << (arena_count/8)) * arena_reserve;  // scale up the arena sizes exponentially
+  }
+  if (arena_reserve < req_size) return false;  // should at least be able to hold the current allocation
+  return (mi_reserve_os_memory(arena_reserve, false /* commit? */, allow_large) == 0);
+}
+
 void* _mi_arena_alloc_aligned(size_t size, size_t alignment, bool* commit, bool* large, bool* is_pinned, bool* is_zero,
                               size_t* memid, mi_os_tld_t* tld)
 {
@@ -208,6 +228,12 @@ void* _mi_arena_alloc_aligned(size_t size, size_t alignment, bool* commit, bool*
   if (size >= MI_ARENA_MIN_OBJ_SIZE && alignment <= MI_SEGMENT_ALIGN) {
     void* p = mi_arena_allocate(numa_node, size, alignment, commit, large, is_pinned, is_zero, memid, tld);
     if (p != NULL) return p;
+
+    // otherwise reserve a new arena and try again
+    if (!mi_option_is_enabled(mi_option_limit_os_alloc) && mi_arena_reserve(size, *large)) {
+      p = mi_arena_allocate(numa_node, size, alignment, commit, large, is_pinned, is_zero, memid, tld);
+      if (p != NULL) return p;
+    }
   }
 
   // finally, fall back to the OS
@@ -227,6 +253,11 @@ void* _mi_arena_alloc(size_t size, bool* commit, bool* large, bool* is_pinned, b
   return _mi_arena_alloc_aligned(size, MI_ARENA_BLOCK_SIZE, commit, large, is_pinned, is_zero, memid, tld);
 }
 
+// Was the memory with this `memid` allocated directly from the OS (and can thus be shrunk)?
+bool _mi_arena_memid_is_os(size_t memid) {
+  return (memid == MI_MEMID_OS);
+}
+
 /* -----------------------------------------------------------
   Arena free
 ----------------------------------------------------------- */
@@ -355,6 +386,25 @@ int mi_reserve_os_memory(size_t size, bool commit, bool allow_large) mi_attr_noe
   return 0;
 }
 
+// Reserve the heap space: one large uncommitted arena from which the segments are carved
+// and committed in place (see `mi_option_reserve_address_space`).
+void _mi_arena_reserve_heap_space(size_t size) {
+  size = _mi_align_up(size, MI_ARENA_BLOCK_SIZE);
+  bool large = false;
+  void* start = _mi_os_alloc_aligned(size, MI_SEGMENT_ALIGN, false /* commit? */, &large, &_mi_stats_main);
+  if (start == NULL) {
+    _mi_warning_message("unable to reserve the heap space (%zu KiB)\n", _mi_divide_up(size, MI_KiB));
+    return;
+  }
+  // track its segments by offset first so they are found as soon as the arena is available
+  if (!_mi_segment_map_init_space(start, size) || !mi_manage_os_memory(start, size, false /* committed */, false /* large */, true /* zero */, -1)) {
+    _mi_os_free_ex(start, size, false, &_mi_stats_main);
+    _mi_warning_message("unable to reserve the heap space (%zu KiB)\n", _mi_divide_up(size, MI_KiB));
+    return;
+  }
+  _mi_verbose_message("reserved heap space of %zu KiB at %p\n", _mi_divide_up(size, MI_KiB), start);
+}
+
 static size_t mi_debug_show_bitmap(const char* prefix, mi_bitmap_field_t* fields, size_t field_count ) {
   size_t inuse_count = 0;
   for (size_t i = 0; i < field_count; i++) {
@@ -31,24 +31,29 @@ static bool mi_heap_visit_pages(mi_heap_t* heap, heap_page_visitor_fun* fn, void
 {
   if (heap==NULL || heap->page_count==0) return 0;
 
+  // other threads do not unlink huge pages while visiting (see `_mi_page_huge_unlink`)
+  _mi_heap_huge_pin(heap, true);
+
   // visit all pages
   #if MI_DEBUG>1
-  size_t total = heap->page_count;
+  size_t total = heap->page_count - heap->huge_freed;
   #endif
   size_t count = 0;
-  for (size_t i = 0; i <= MI_BIN_FULL; i++) {
+  bool ok = true;
+  for (size_t i = 0; ok && i <= MI_BIN_FULL; i++) {
     mi_page_queue_t* pq = &heap->pages[i];
     mi_page_t* page = pq->first;
     while(page != NULL) {
       mi_page_t* next = page->next; // save next in case the page gets removed from the queue
       mi_assert_internal(mi_page_heap(page) == heap);
       count++;
-      if (!fn(heap, pq, page, arg1, arg2)) return false;
+      if (!fn(heap, pq, page, arg1, arg2)) { ok = false; break; }
       page = next; // and continue
     }
   }
-  mi_assert_internal(count == total);
-  return true;
+  mi_assert_internal(!ok || count == total);
+  _mi_heap_huge_pin(heap, false);
+  return ok;
 }
 
 
@@ -143,8 +148,8 @@ static void mi_heap_collect_ex(mi_heap_t* heap, mi_collect_t collect)
     mi_heap_visit_pages(heap, &mi_heap_page_never_delayed_free, NULL, NULL);
   }
 
-  // free thread delayed blocks.
-  // (if abandoning, after this there are no more thread-delayed references into the pages.)
+  // process pages with thread delayed frees.
+  // (if abandoning, after this there are no more thread-delayed references to the pages.)
   _mi_heap_delayed_free(heap);
 
   // collect retired pages
@@ -152,7 +157,7 @@ static void mi_heap_collect_ex(mi_heap_t* heap, mi_collect_t collect)
 
   // collect all pages owned by this thread
   mi_heap_visit_pages(heap, &mi_heap_page_collect, &collect, NULL);
-  mi_assert_internal( collect != MI_ABANDON || mi_atomic_load_ptr_acquire(mi_block_t,&heap->thread_delayed_free) == NULL );
+  mi_assert_internal( collect != MI_ABANDON || mi_atomic_load_ptr_acquire(mi_page_t,&heap->thread_delayed_pages) == NULL );
 
   // collect abandoned segments (in particular, decommit expired parts of segments in the abandoned segment list)
   // note: forced decommit can be quite expensive if many threads are created/destroyed so we do not force on abandonment
@@ -236,8 +241,51 @@ static void mi_heap_reset_pages(mi_heap_t* heap) {
   memset(&heap->pages_free_medium, 0, sizeof(heap->pages_free_medium));
 #endif
   _mi_memcpy_aligned(&heap->pages, &_mi_heap_empty.pages, sizeof(heap->pages));
-  heap->thread_delayed_free = NULL;
+  heap->thread_delayed_pages = NULL;
+  heap->page_count = 0;
+  for (size_t i = 0; i < MI_BIN_HUGE; i++) { heap->page_retire[i].retired = 0; }
+  heap->page_retired_min = MI_BIN_FULL;
+  heap->page_retired_max = 0;
+}
+
+static void mi_heap_fork_reset(mi_heap_t* heap) {
+  _mi_memcpy_aligned(&heap->pages_free_direct, &_mi_heap_empty.pages_free_direct, sizeof(heap->pages_free_direct));
+  _mi_memcpy_aligned(&heap->pages, &_mi_heap_empty.pages, sizeof(heap->pages));
+  heap->thread_delayed_pages = NULL;
   heap->page_count = 0;
+  for (size_t i = 0; i < MI_BIN_HUGE; i++) { heap->page_retire[i].retired = 0; }
+  heap->page_retired_min = MI_BIN_FULL;
+  heap->page_retired_max = 0;
+  mi_atomic_store_release(&heap->huge_lock, false);
+  heap->huge_pinned = 0;
+  heap->huge_freed = 0;
+  heap->next = NULL;
+}
+
+// Reset the heaps of a thread in a forked child where segments were excluded
+// from the fork (see `_mi_fork_child`): all pages are either gone or abandoned.
+// A heap that was allocated in an excluded segment is gone as well, and so are
+// the heaps after it in the list as we cannot read its `next` field.
+void _mi_heap_fork_child(mi_tld_t* tld) {
+  mi_heap_t* const backing = tld->heap_backing;
+  if (backing == NULL || !mi_heap_is_initialized(backing)) return;
+  mi_heap_t* heap = tld->heaps;
+  mi_heap_t* last = NULL;
+  bool has_backing = false;
+  tld->heaps = NULL;
+  while (heap != NULL && (heap == backing || _mi_segment_fork_visible(heap))) {
+    mi_heap_t* const next = heap->next;
+    mi_heap_fork_reset(heap);
+    if (last == NULL) { tld->heaps = heap; } else { last->next = heap; }
+    last = heap;
+    if (heap == backing) { has_backing = true; }
+    heap = next;
+  }
+  if (!has_backing) {
+    mi_heap_fork_reset(backing);
+    if (last == NULL) { tld->heaps = backing; } else { last->next = backing; }
+  }
+  _mi_segments_fork_child(&tld->segments);
 }
 
 // called from `mi_heap_destroy` and `mi_heap_delete` to free the internal heap resources.
@@ -282,7 +330,7 @@ static bool _mi_heap_page_destroy(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_
   MI_UNUSED(heap);
   MI_UNUSED(pq);
 
-  // ensure no more thread_delayed_free will be added
+  // ensure the page is no longer added to the `thread_delayed_pages`
   _mi_page_use_delayed_free(page, MI_NEVER_DELAYED_FREE, false);
 
   // stats
@@ -355,6 +403,10 @@ static void mi_heap_absorb(mi_heap_t* heap, mi_heap_t* from) {
 
   // reduce the size of the delayed frees
   _mi_heap_delayed_free(from);
+
+  // other threads do not unlink huge pages while they move between the heaps
+  _mi_heap_huge_pin(heap, true);
+  _mi_heap_huge_pin(from, true);
   
   // transfer all pages by appending the queues; this will set a new heap field 
   // so threads may do delayed frees in either heap for a while.
@@ -367,21 +419,44 @@ static void mi_heap_absorb(mi_heap_t* heap, mi_heap_t* from) {
     heap->page_count += pcount;
     from->page_count -= pcount;
   }
+  _mi_heap_huge_pin(from, false);
+  _mi_heap_huge_pin(heap, false);
   mi_assert_internal(from->page_count == 0);
 
   // and do outstanding delayed frees in the `from` heap  
   // note: be careful here as the `heap` field in all those pages no longer point to `from`,
-  // turns out to be ok as `_mi_heap_delayed_free` only visits the list and calls a 
-  // the regular `_mi_free_delayed_block` which is safe.
+  // turns out to be ok as `_mi_heap_delayed_free` only visits the list and then
+  // uses the (new) page heap to retire or unfull the page which is safe.
   _mi_heap_delayed_free(from);  
   #if !defined(_MSC_VER) || (_MSC_VER > 1900) // somehow the following line gives an error in VS2015, issue #353
-  mi_assert_internal(mi_atomic_load_ptr_relaxed(mi_block_t,&from->thread_delayed_free) == NULL);
+  mi_assert_internal(mi_atomic_load_ptr_relaxed(mi_page_t,&from->thread_delayed_pages) == NULL);
   #endif
 
   // and reset the `from` heap
   mi_heap_reset_pages(from);  
 }
 
+// Transfer the page of `p` to `heap` if `p` is the only live block in it.
+bool mi_heap_adopt_page(mi_heap_t* heap, const void* p) {
+  if (heap==NULL || !mi_heap_is_initialized(heap) || p==NULL) return false;
+  if (heap->thread_id != _mi_thread_id()) return false;
+  mi_segment_t* const segment = _mi_ptr_segment(p);
+  if (mi_atomic_load_relaxed(&segment->thread_id) != heap->thread_id) return false;  // also for abandoned segments
+  mi_page_t* const page = _mi_segment_page_of(segment, p);
+  mi_heap_t* const from = mi_page_heap(page);
+  if (from == heap) return true;
+  if (from == NULL || from->tld != heap->tld) return false;
+  // the page may be in the delayed free list of `from` (with `MI_NO_DELAYED_FREE` set)
+  // and would then never be collected or notify a heap again; so process that list first
+  _mi_heap_delayed_free(from);
+  _mi_page_free_collect(page, false);
+  if (page->used != 1) return false;  // other blocks in the page are still in use
+  _mi_page_queue_transfer(heap, page);
+  // and again for a concurrent free that added it just before the transfer (as in `mi_heap_absorb`)
+  _mi_heap_delayed_free(from);
+  return true;
+}
+
 // Safe delete a heap without freeing any still allocated blocks in that heap.
 void mi_heap_delete(mi_heap_t* heap)
 {
@@ -460,6 +535,26 @@ bool mi_check_owned(const void* p) {
   return mi_heap_check_owned(mi_get_default_heap(), p);
 }
 
+#if MI_LIVE_BITS
+// Return the index of the first live block at or after block `i` in a page (or the page capacity).
+// Skips a whole word of live bits at a time.
+static size_t mi_page_next_live(const mi_page_t* page, const uint8_t* pstart, size_t bsize, size_t i) {
+  const mi_segment_t* const segment = _mi_page_segment(page);
+  _Atomic(uintptr_t)* const live = (_Atomic(uintptr_t)*)mi_atomic_load_ptr_relaxed(uintptr_t, &segment->live);
+  const size_t base = (size_t)(pstart - (const uint8_t*)segment) / MI_INTPTR_SIZE;  // bit of the first block
+  const size_t stride = bsize / MI_INTPTR_SIZE;                                       // bits per block
+  while (i < page->capacity) {
+    const size_t bitidx = base + (i * stride);
+    const uintptr_t bits = mi_atomic_load_relaxed(&live[bitidx / MI_INTPTR_BITS]) >> (bitidx % MI_INTPTR_BITS);
+    if ((bits & 1) != 0) return i;
+    // continue at the block of the next set bit (or of the next word)
+    const size_t next = bitidx + (bits == 0 ? MI_INTPTR_BITS - (bitidx % MI_INTPTR_BITS) : mi_ctz(bits));
+    i = _mi_divide_up(next - base, stride);
+  }
+  return page->capacity;
+}
+#endif
+
 /* -----------------------------------------------------------
   Visit all heap blocks and areas
   Todo: enable visiting abandoned pages, and
@@ -495,6 +590,17 @@ static bool mi_heap_area_visit_blocks(const mi_heap_area_ex_t* xarea, mi_block_v
     return visitor(mi_page_heap(page), area, pstart, ubsize, arg);
   }
 
+  #if MI_LIVE_BITS
+  // the live bits give the used blocks directly
+  size_t used_count = 0;
+  for (size_t i = mi_page_next_live(page, pstart, bsize, 0); i < page->capacity; i = mi_page_next_live(page, pstart, bsize, i + 1)) {
+    used_count++;
+    uint8_t* block = pstart + (i * bsize);
+    if (!visitor(mi_page_heap(page), area, block, ubsize, arg)) return false;
+  }
+  mi_assert_internal(page->used == used_count);
+  return true;
+  #else
   // create a bitmap of free blocks.
   #define MI_MAX_BLOCKS   (MI_SMALL_PAGE_SIZE / sizeof(void*))
   uintptr_t free_map[MI_MAX_BLOCKS / sizeof(uintptr_t)];
@@ -531,6 +637,7 @@ static bool mi_heap_area_visit_blocks(const mi_heap_area_ex_t* xarea, mi_block_v
   }
   mi_assert_internal(page->used == used_count);
   return true;
+  #endif
 }
 
 typedef bool (mi_heap_area_visit_fun)(const mi_heap_t* heap, const mi_heap_area_ex_t* area, void* arg);
@@ -583,22 +690,270 @@ bool mi_heap_visit_blocks(const mi_heap_t* heap, bool visit_blocks, mi_block_vis
   return mi_heap_visit_areas(heap, &mi_heap_area_visitor, &args);
 }
 
-extern mi_detached_page_queue_t detached_page_queue;
 
-static void mi_heap_visit_huge_pages(mi_iterate_info_t* iterate_info)
-{
-  _mi_page_lock_detached_page_queue();
-  mi_page_t* page = detached_page_queue.first;
-  while (page != NULL) {
-    mi_segment_t* segment = _mi_page_segment(page);
-    uint8_t* block = _mi_page_start(segment, page, NULL);
-    if ((uintptr_t)block >= iterate_info->start_ptr && (uintptr_t)block < iterate_info->end_ptr) {
-      size_t block_size = mi_page_block_size(page);
-      iterate_info->callback(block, block_size, iterate_info->arg);
+/* -----------------------------------------------------------
+  Sweep: free blocks in bulk by pushing them directly on the
+  page free list (instead of calling `mi_free` per block).
+----------------------------------------------------------- */
+
+// return `true` to free the block
+typedef bool (mi_block_sweep_fun)(mi_page_t* page, mi_block_t* block, void* arg);
+
+static inline void mi_page_sweep_free(mi_page_t* page, mi_block_t* block) {
+  _mi_stat_free(page, block);
+  #if (MI_DEBUG!=0)
+  memset(block, MI_DEBUG_FREED, mi_page_block_size(page));
+  #endif
+  mi_block_set_next(page, block, page->free);
+  page->free = block;
+}
+
+// Free all used blocks in a page for which `fun` returns `true`; returns the number of freed blocks.
+// Call `mi_page_sweep_done` afterwards.
+static size_t mi_page_sweep(mi_page_t* page, mi_block_sweep_fun* fun, void* arg) {
+  _mi_page_free_collect(page, true);
+  mi_assert_internal(page->local_free == NULL);
+  if (page->used == 0) return 0;
+
+  const size_t bsize = mi_page_block_size(page);
+  uint8_t* const pstart = _mi_page_start(_mi_page_segment(page), page, NULL);
+
+  size_t freed = 0;
+  #if MI_LIVE_BITS
+  // the live bits give the used blocks directly
+  for (size_t i = mi_page_next_live(page, pstart, bsize, 0); i < page->capacity; i = mi_page_next_live(page, pstart, bsize, i + 1)) {
+    mi_block_t* const block = (mi_block_t*)(pstart + (i * bsize));
+    if (fun(page, block, arg)) {
+      mi_block_clear_live(block);
+      mi_page_sweep_free(page, block);
+      freed++;
+    }
+  }
+  #else
+  // create a bitmap of the free blocks
+  mi_assert_internal(page->capacity <= MI_MAX_BLOCKS);
+  uintptr_t free_map[MI_MAX_BLOCKS / MI_INTPTR_BITS];
+  const size_t map_words = _mi_divide_up(page->capacity, MI_INTPTR_BITS);
+  memset(free_map, 0, map_words * sizeof(uintptr_t));
+  for (mi_block_t* block = page->free; block != NULL; block = mi_block_next(page, block)) {
+    const size_t blockidx = ((uint8_t*)block - pstart) / bsize;
+    mi_assert_internal(blockidx < page->capacity);
+    free_map[blockidx / MI_INTPTR_BITS] |= ((uintptr_t)1 << (blockidx % MI_INTPTR_BITS));
+  }
+
+  // visit the used blocks and push the ones to free on the free list
+  for (size_t i = 0; i < page->capacity; i++) {
+    const uintptr_t m = free_map[i / MI_INTPTR_BITS];
+    if ((i % MI_INTPTR_BITS) == 0 && m == UINTPTR_MAX) {
+      i += (MI_INTPTR_BITS - 1);  // skip a run of free blocks
+      continue;
+    }
+    if ((m & ((uintptr_t)1 << (i % MI_INTPTR_BITS))) != 0) continue;
+    mi_block_t* const block = (mi_block_t*)(pstart + (i * bsize));
+    if (fun(page, block, arg)) {
+      mi_page_sweep_free(page, block);
+      freed++;
+    }
+  }
+  #endif
+  mi_assert_internal(freed <= page->used);
+  page->used -= freed;
+  return freed;
+}
+
+// Free the page if it became empty, or move it out of the full queue
+static void mi_page_sweep_done(mi_page_queue_t* pq, mi_page_t* page, size_t freed) {
+  if (freed == 0) return;
+  if (mi_page_all_free(page)) {
+    _mi_page_free(page, pq, false);
+  }
+  else if (mi_page_is_in_full(page)) {
+    _mi_page_unfull(page);
+  }
+}
+
+
+// The predicate is called without holding the malloc lock so it can use mimalloc itself:
+// per page, the used blocks are collected first (with the lock), then the predicate
+// selects the blocks to free, and finally the selected blocks are freed (with the lock).
+#define MI_FREE_IF_MAX_BLOCKS  (MI_SMALL_PAGE_SIZE / sizeof(void*))  // maximal page capacity
+
+typedef struct mi_free_if_args_s {
+  mi_block_predicate_fun* predicate;
+  void*     arg;
+  size_t    freed;
+  uint8_t*  pstart;
+  size_t    bsize;
+  uintptr_t selected[MI_FREE_IF_MAX_BLOCKS / MI_INTPTR_BITS];  // bit per block of the current page
+} mi_free_if_args_t;
+
+static bool mi_block_select_used(mi_page_t* page, mi_block_t* block, void* arg) {
+  MI_UNUSED(page);
+  mi_free_if_args_t* args = (mi_free_if_args_t*)arg;
+  const size_t i = (size_t)((uint8_t*)block - args->pstart) / args->bsize;
+  args->selected[i / MI_INTPTR_BITS] |= ((uintptr_t)1 << (i % MI_INTPTR_BITS));
+  return false;  // do not free yet
+}
+
+static bool mi_block_is_selected(mi_page_t* page, mi_block_t* block, void* arg) {
+  MI_UNUSED(page);
+  const mi_free_if_args_t* args = (const mi_free_if_args_t*)arg;
+  const size_t i = (size_t)((uint8_t*)block - args->pstart) / args->bsize;
+  return ((args->selected[i / MI_INTPTR_BITS] & ((uintptr_t)1 << (i % MI_INTPTR_BITS))) != 0);
+}
+
+static bool mi_heap_page_free_if(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_t* page, void* arg1, void* arg2) {
+  MI_UNUSED(arg2);
+  mi_free_if_args_t* args = (mi_free_if_args_t*)arg1;
+  mi_assert_internal(page->capacity <= MI_FREE_IF_MAX_BLOCKS);
+  const size_t map_words = _mi_divide_up(page->capacity, MI_INTPTR_BITS);
+  args->pstart = _mi_page_start(_mi_page_segment(page), page, NULL);
+  args->bsize = mi_page_block_size(page);
+  memset(args->selected, 0, map_words * sizeof(uintptr_t));
+
+  // collect the used blocks
+  bool locked = _mi_heap_lock_malloc();
+  mi_page_sweep(page, &mi_block_select_used, args);
+  if (locked) { _mi_heap_unlock_malloc(); }
+
+  // select the blocks to free
+  const size_t ubsize = mi_page_usable_block_size(page);
+  size_t selected = 0;
+  for (size_t w = 0; w < map_words; w++) {
+    uintptr_t used = args->selected[w];
+    while (used != 0) {
+      const size_t bit = mi_ctz(used);
+      used &= (used - 1);
+      void* const block = args->pstart + (((w * MI_INTPTR_BITS) + bit) * args->bsize);
+      if (args->predicate(heap, block, ubsize, args->arg)) {
+        selected++;
+      }
+      else {
+        args->selected[w] &= ~((uintptr_t)1 << bit);
+      }
     }
-    page = page->next;
   }
-  _mi_page_unlock_detached_page_queue();
+  if (selected == 0) return true;
+
+  // and free them
+  locked = _mi_heap_lock_malloc();
+  const size_t freed = mi_page_sweep(page, &mi_block_is_selected, args);
+  mi_page_sweep_done(pq, page, freed);
+  if (locked) { _mi_heap_unlock_malloc(); }
+  args->freed += freed;
+  return true;
+}
+
+size_t mi_heap_free_if(mi_heap_t* heap, mi_block_predicate_fun* predicate, void* arg) mi_attr_noexcept {
+  if (heap==NULL || !mi_heap_is_initialized(heap) || predicate==NULL) return 0;
+  mi_assert(heap->thread_id == _mi_thread_id());
+  bool locked = _mi_heap_lock_malloc();
+  _mi_heap_delayed_free(heap);  // so blocks freed by other threads are seen as free
+  if (locked) {
+    _mi_heap_unlock_malloc();
+  }
+  mi_free_if_args_t args;
+  args.predicate = predicate;
+  args.arg = arg;
+  args.freed = 0;
+  mi_heap_visit_pages(heap, &mi_heap_page_free_if, &args, NULL);
+  return args.freed;
+}
+
+
+/* -----------------------------------------------------------
+  Mark bits
+  A garbage collector can mark blocks in a side table of the
+  segment (one bit per word, allocated on the first mark) and
+  then sweep all unmarked blocks of a heap at once.
+----------------------------------------------------------- */
+
+static inline size_t mi_segment_mark_index(const mi_segment_t* segment, const void* block) {
+  return ((size_t)((const uint8_t*)block - (const uint8_t*)segment) / MI_INTPTR_SIZE);
+}
+
+// Return the word with the mark bit for the block of `p` (or NULL if there are no marks)
+static _Atomic(uintptr_t)* mi_block_mark_word(const void* p, bool create, uintptr_t* mask) {
+  if (p == NULL) return NULL;
+  mi_segment_t* const segment = _mi_ptr_segment(p);
+  bool valid = (_mi_ptr_cookie(segment) == segment->cookie);
+  mi_assert_internal(valid);
+  if (mi_unlikely(!valid)) return NULL;
+  _Atomic(uintptr_t)* const marks = _mi_segment_marks(segment, create);
+  if (marks == NULL) return NULL;
+  const mi_page_t* const page = _mi_segment_page_of(segment, p);
+  const void* const block = (mi_page_has_aligned(page) ? _mi_page_ptr_unalign(segment, page, p) : p);
+  const size_t bitidx = mi_segment_mark_index(segment, block);
+  *mask = ((uintptr_t)1 << (bitidx % MI_INTPTR_BITS));
+  return &marks[bitidx / MI_INTPTR_BITS];
+}
+
+bool mi_block_mark(const void* p) mi_attr_noexcept {
+  uintptr_t mask;
+  _Atomic(uintptr_t)* const word = mi_block_mark_word(p, true, &mask);
+  if (word == NULL) return false;
+  return ((mi_atomic_or_acq_rel(word, mask) & mask) != 0);
+}
+
+void mi_block_unmark(const void* p) mi_attr_noexcept {
+  uintptr_t mask;
+  _Atomic(uintptr_t)* const word = mi_block_mark_word(p, false, &mask);
+  if (word == NULL) return;
+  mi_atomic_and_acq_rel(word, ~mask);
+}
+
+bool mi_block_is_marked(const void* p) mi_attr_noexcept {
+  uintptr_t mask;
+  _Atomic(uintptr_t)* const word = mi_block_mark_word(p, false, &mask);
+  if (word == NULL) return false;
+  return ((mi_atomic_load_relaxed(word) & mask) != 0);
+}
+
+static void mi_page_marks_clear(mi_page_t* page) {
+  mi_segment_t* const segment = _mi_page_segment(page);
+  size_t psize;
+  uint8_t* const pstart = _mi_page_start(segment, page, &psize);
+  _mi_segment_marks_clear(segment, pstart, psize);
+}
+
+static bool mi_heap_page_marks_clear(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_t* page, void* arg1, void* arg2) {
+  MI_UNUSED(heap); MI_UNUSED(pq); MI_UNUSED(arg1); MI_UNUSED(arg2);
+  mi_page_marks_clear(page);
+  return true;
+}
+
+void mi_heap_clear_marks(mi_heap_t* heap) mi_attr_noexcept {
+  if (heap==NULL || !mi_heap_is_initialized(heap)) return;
+  mi_heap_visit_pages(heap, &mi_heap_page_marks_clear, NULL, NULL);
+}
+
+static bool mi_block_is_unmarked(mi_page_t* page, mi_block_t* block, void* arg) {
+  _Atomic(uintptr_t)* const marks = (_Atomic(uintptr_t)*)arg;
+  if (marks == NULL) return true;  // nothing in this segment was marked
+  const size_t bitidx = mi_segment_mark_index(_mi_page_segment(page), block);
+  return ((mi_atomic_load_relaxed(&marks[bitidx / MI_INTPTR_BITS]) & ((uintptr_t)1 << (bitidx % MI_INTPTR_BITS))) == 0);
+}
+
+static bool mi_heap_page_sweep_unmarked(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_t* page, void* arg1, void* arg2) {
+  MI_UNUSED(heap); MI_UNUSED(arg2);
+  const size_t freed = mi_page_sweep(page, &mi_block_is_unmarked, _mi_segment_marks(_mi_page_segment(page), false));
+  mi_page_marks_clear(page);  // unmark the survivors (before the page and segment may be freed)
+  mi_page_sweep_done(pq, page, freed);
+  *((size_t*)arg1) += freed;
+  return true;
+}
+
+size_t mi_heap_sweep_unmarked(mi_heap_t* heap) mi_attr_noexcept {
+  if (heap==NULL || !mi_heap_is_initialized(heap)) return 0;
+  mi_assert(heap->thread_id == _mi_thread_id());
+  bool locked = _mi_heap_lock_malloc();
+  _mi_heap_delayed_free(heap);  // so blocks freed by other threads are seen as free
+  size_t freed = 0;
+  mi_heap_visit_pages(heap, &mi_heap_page_sweep_unmarked, &freed, NULL);
+  if (locked) {
+    _mi_heap_unlock_malloc();
+  }
+  return freed;
 }
 
 static bool mi_malloc_iterate_visitor(const mi_heap_t* heap, const mi_heap_area_t* area, void* block, size_t block_size, void* arg) {
@@ -627,7 +982,6 @@ int mi_malloc_iterate(void* base, size_t size, void (*callback)(void* base, size
     heap = heap->next_thread_heap;
   }
   _mi_heap_unlock_heap_queue();
-  mi_heap_visit_huge_pages(&iterate_info);
   mi_segment_walk_through_abandoned_segments(&iterate_info);
   return 0;
 }
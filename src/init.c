@@ -74,11 +74,8 @@ const mi_page_t _mi_page_empty = {
   MI_ATOMIC_VAR_INIT(0), // xthread_free
   MI_ATOMIC_VAR_INIT(0), // xheap
   NULL,    // next page
-  NULL     // prev page
-
-  #if MI_INTPTR_SIZE==8
-  , { 0 }  // padding
-  #endif
+  NULL,    // prev page
+  NULL     // next delayed page
 };
 
 #define MI_PAGE_EMPTY() ((mi_page_t*)&_mi_page_empty)
@@ -126,7 +123,8 @@ const mi_page_t _mi_page_empty = {
   MI_STAT_COUNT_NULL(), MI_STAT_COUNT_NULL(), \
   MI_STAT_COUNT_NULL(), MI_STAT_COUNT_NULL(), \
   { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 },     \
-  { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } \
+  { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 },     \
+  { 0, 0 } \
   MI_STAT_COUNT_END_NULL()
 
 
@@ -161,10 +159,12 @@ mi_decl_cache_align const mi_heap_t _mi_heap_empty = {
   { {0}, {0}, 0 },
   0,                // page count
   MI_BIN_FULL, 0,   // page retired min/max
+  { {0, 0, false, 0} }, // page retire state
   NULL,             // next
   NULL,             // next thread heap
   NULL,             // prev thread heap
-  false
+  false,
+  MI_ATOMIC_VAR_INIT(false), 0, 0  // huge lock, pinned, freed
 };
 
 #define tld_empty_stats  ((mi_stats_t*)((uint8_t*)&tld_empty + offsetof(mi_tld_t,stats)))
@@ -207,10 +207,12 @@ mi_heap_t _mi_heap_main = {
   { {0x846ca68b}, {0}, 0 },  // random
   0,                // page count
   MI_BIN_FULL, 0,   // page retired min/max
+  { {0, 0, false, 0} }, // page retire state
   NULL,             // next heap
   NULL,             // next thread heap
   NULL,             // prev thread heap
-  false             // can reclaim
+  false,            // can reclaim
+  MI_ATOMIC_VAR_INIT(false), 0, 0  // huge lock, pinned, freed
 };
 
 bool _mi_process_is_initialized = false;  // set to `true` in `mi_process_init`.
@@ -222,11 +224,21 @@ mi_stats_t _mi_stats_get_empty_stats(void) {
   return empty_stats;
 }
 
+// Non-secure builds only use the heap randomness for heuristics (like address hints)
+// so a weak seed suffices and saves a system call on process and thread start.
+static void mi_heap_random_init(mi_heap_t* heap) {
+  #if MI_SECURE > 0
+  _mi_random_init(&heap->random);
+  #else
+  _mi_random_init_weak(&heap->random);
+  #endif
+}
+
 static void mi_heap_main_init(void) {
   if (_mi_heap_main.cookie == 0) {
     _mi_heap_main.thread_id = _mi_thread_id();
     _mi_heap_main.cookie = _mi_os_random_weak((uintptr_t)&mi_heap_main_init);
-    _mi_random_init(&_mi_heap_main.random);
+    mi_heap_random_init(&_mi_heap_main);
     _mi_heap_main.keys[0] = _mi_heap_random_next(&_mi_heap_main);
     _mi_heap_main.keys[1] = _mi_heap_random_next(&_mi_heap_main);
     heap_queue_last = &_mi_heap_main;
@@ -332,7 +344,7 @@ static bool _mi_heap_init(void) {
     _mi_memcpy_aligned(tld, &tld_empty, sizeof(*tld));
     _mi_memcpy_aligned(heap, &_mi_heap_empty, sizeof(*heap));
     heap->thread_id = _mi_thread_id();
-    _mi_random_init(&heap->random);
+    mi_heap_random_init(heap);
     heap->cookie  = _mi_heap_random_next(heap) | 1;
     heap->keys[0] = _mi_heap_random_next(heap);
     heap->keys[1] = _mi_heap_random_next(heap);
@@ -537,6 +549,27 @@ void _mi_heap_set_default_direct(mi_heap_t* heap)  {
   #endif
 }
 
+// Called in the child process after a `fork` once segments were excluded from
+// forking (see `mi_option_exclude_from_fork`). Those segments are not present
+// in the child, so all heaps are reset to empty and allocate fresh segments.
+// Any segments that are still present (as they were not excluded) are abandoned
+// so their blocks can still be freed and their pages reclaimed.
+// The child is single threaded here so no locks are taken.
+void _mi_fork_child(void) {
+  if (!_mi_segments_fork_excluded()) return;  // all segments are still present
+  const mi_threadid_t tid = _mi_thread_id();
+  const bool initialized = mi_heap_is_initialized(mi_get_default_heap());
+  for (mi_heap_t* heap = _mi_heap_main_get(); heap != NULL; heap = heap->next_thread_heap) {
+    if (heap->tld == NULL) continue;
+    _mi_heap_fork_child(heap->tld);
+    // the default heap may have been allocated in an excluded segment
+    if (initialized && heap->thread_id == tid) { _mi_heap_set_default_direct(heap); }
+  }
+  _mi_abandoned_fork_child();
+  _mi_segment_map_fork_child();
+  _mi_segments_fork_child_abandon();
+}
+
 
 // --------------------------------------------------------
 // Run functions on process init/done, and thread init/done
@@ -668,6 +701,12 @@ void mi_process_init(void) mi_attr_noexcept {
       mi_reserve_huge_os_pages_interleave(pages, 0, pages*500);
     }
   } 
+  if (mi_option_is_enabled(mi_option_reserve_address_space)) {
+    long ksize = mi_option_get(mi_option_reserve_address_space);
+    if (ksize > 0) {
+      _mi_arena_reserve_heap_space((size_t)ksize*MI_KiB);
+    }
+  }
   if (mi_option_is_enabled(mi_option_reserve_os_memory)) {
     long ksize = mi_option_get(mi_option_reserve_os_memory);
     if (ksize > 0) {
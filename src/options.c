@@ -94,7 +94,20 @@ static mi_option_desc_t options[_mi_option_last] =
   { 8,    UNINIT, MI_OPTION(max_segment_reclaim)},// max. number of segment reclaims from the abandoned segments per try.  
   { 1,    UNINIT, MI_OPTION(allow_decommit) },    // decommit slices when no longer used (after decommit_delay milli-seconds)
   { 500,  UNINIT, MI_OPTION(segment_decommit_delay) }, // decommit delay in milli-seconds for freed segments
-  { 2,    UNINIT, MI_OPTION(decommit_extend_delay) }
+  { 2,    UNINIT, MI_OPTION(decommit_extend_delay) },
+  { 0,    UNINIT, MI_OPTION(commit_limit) },      // commit limit in MiB passed to deferred free functions as a hint; not enforced (0 = none)
+  { 0,    UNINIT, MI_OPTION(exclude_from_fork) }, // 1 = exclude segments from fork (MADV_DONTFORK), 2 = zero them in the child (MADV_WIPEONFORK)
+#if (MI_INTPTR_SIZE>4) && !defined(MI_USE_SBRK) && !defined(__wasi__)
+  { 1024L * 1024L, UNINIT, MI_OPTION(arena_reserve) }, // reserve address space 1GiB at a time (in KiB)
+#else
+  { 0,    UNINIT, MI_OPTION(arena_reserve) },     // no on-demand reservation on 32-bit or `sbrk` systems
+#endif
+  { 0,    UNINIT, MI_OPTION(reserve_address_space) }, // reserve one heap space of N KiB at startup (e.g. 64GiB) for all segments
+#if (MI_INTPTR_SIZE>4)
+  { 256,  UNINIT, MI_OPTION(huge_cache_max) }     // keep at most 256MiB of freed huge segments for reuse
+#else
+  { 32,   UNINIT, MI_OPTION(huge_cache_max) }
+#endif
 };
 
 static void mi_option_init(mi_option_desc_t* desc);
@@ -109,12 +122,15 @@ void _mi_options_init(void) {
   mi_recurse_key_init();
 #endif
   mi_add_stderr_output(); // now it safe to use stderr for output
-  for(int i = 0; i < _mi_option_last; i++ ) {
-    mi_option_t option = (mi_option_t)i;
-    long l = mi_option_get(option); MI_UNUSED(l); // initialize
-    if (option != mi_option_verbose) {
-      mi_option_desc_t* desc = &options[option];
-      _mi_verbose_message("option '%s': %ld\n", desc->name, desc->value);
+  if (mi_option_is_enabled(mi_option_verbose)) {
+    // otherwise options are read from the environment on first use
+    for(int i = 0; i < _mi_option_last; i++ ) {
+      mi_option_t option = (mi_option_t)i;
+      long l = mi_option_get(option); MI_UNUSED(l); // initialize
+      if (option != mi_option_verbose) {
+        mi_option_desc_t* desc = &options[option];
+        _mi_verbose_message("option '%s': %ld\n", desc->name, desc->value);
+      }
     }
   }
   mi_max_error_count = mi_option_get(mi_option_max_errors);
@@ -624,7 +640,7 @@ static void mi_option_init(mi_option_desc_t* desc) {
     else {
       char* end = buf;
       long value = strtol(buf, &end, 10);
-      if (desc->option == mi_option_reserve_os_memory) {
+      if (desc->option == mi_option_reserve_os_memory || desc->option == mi_option_arena_reserve || desc->option == mi_option_reserve_address_space) {
         // this option is interpreted in KiB to prevent overflow of `long`
         if (*end == 'K') { end++; }
         else if (*end == 'M') { value *= MI_KiB; end++; }
@@ -90,10 +90,16 @@ static size_t os_alloc_granularity = 4096;
 static size_t large_os_page_size = 0;
 
 // is memory overcommit allowed? 
-// set dynamically in _mi_os_init (and if true we use MAP_NORESERVE)
+// detected on first use as it may need to read from `/proc` (and if true we use MAP_NORESERVE)
 static bool os_overcommit = true;
+static bool os_overcommit_detected = false;
+static void os_detect_overcommit(void);
 
 bool _mi_os_has_overcommit(void) {
+  if (mi_unlikely(!os_overcommit_detected)) {
+    os_detect_overcommit();
+    os_overcommit_detected = true;
+  }
   return os_overcommit;
 }
 
@@ -206,9 +212,12 @@ static bool mi_win_enable_large_os_pages(void)
   return (ok!=0);
 }
 
+static void os_detect_overcommit(void) {
+  os_overcommit = false;
+}
+
 void _mi_os_init(void) 
 {
-  os_overcommit = false;
   // get the page size
   SYSTEM_INFO si;
   GetSystemInfo(&si);
@@ -242,8 +251,11 @@ void _mi_os_init(void)
   }
 }
 #elif defined(__wasi__)
-void _mi_os_init(void) {
+static void os_detect_overcommit(void) {
   os_overcommit = false;
+}
+
+void _mi_os_init(void) {
   os_page_size = 64*MI_KiB; // WebAssembly has a fixed page size: 64KiB
   os_alloc_granularity = 16;
 }
@@ -281,7 +293,6 @@ void _mi_os_init(void) {
     os_alloc_granularity = os_page_size;
   }
   large_os_page_size = 2*MI_MiB; // TODO: can we query the OS for this?
-  os_detect_overcommit();
 }
 #endif
 
@@ -607,9 +618,13 @@ static void* mi_unix_mmap(void* addr, size_t size, size_t try_alignment, int pro
   #endif
   const int fd = mi_unix_mmap_fd();
   int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  #if defined(__linux__)
+  flags |= MAP_NORESERVE;  // Linux ignores it if overcommit is disabled so we do not need to detect that
+  #else
   if (_mi_os_has_overcommit()) {
     flags |= MAP_NORESERVE;
   }  
+  #endif
   #if defined(PROT_MAX)
   protect_flags |= PROT_MAX(PROT_READ | PROT_WRITE); // BSD
   #endif    
@@ -704,6 +719,108 @@ static void* mi_unix_mmap(void* addr, size_t size, size_t try_alignment, int pro
 #endif
 
 
+/* -----------------------------------------------------------
+  Memory mappings (VMA's) on Linux.
+  Each change of protection or advice on part of a mapping splits
+  it, and a process can have at most `vm.max_map_count` mappings
+  (usually 65530) after which `mmap` and `mprotect` fail with ENOMEM.
+  We therefore avoid splitting mappings where possible:
+  - with overcommit, uncommitted memory is reserved read/write (but
+    `MAP_NORESERVE`) such that a later commit does not change the
+    protection of just a part of the reservation;
+  - decommit uses `MADV_DONTNEED` which never splits a mapping;
+  - in debug and secure mode we still use `PROT_NONE` (and exclude
+    segments from fork) to trap on illegal access, but only while the
+    number of mappings is well below the limit.
+  The number of mappings is counted from `/proc/self/maps` at most once
+  per `MI_VMA_COUNT_INTERVAL` milliseconds.
+-------------------------------------------------------------- */
+#if defined(__linux__) && !defined(MI_USE_SBRK)
+#define MI_OS_TRACK_VMA
+
+#define MI_VMA_COUNT_INTERVAL  (1000)
+
+static _Atomic(size_t)     mi_vma_count;         // last counted number of mappings
+static _Atomic(size_t)     mi_vma_max;           // `vm.max_map_count` (read on first use)
+static _Atomic(mi_msecs_t) mi_vma_count_expire;  // when to count again
+static _Atomic(size_t)     mi_vma_pressure;      // set once we are near the limit
+
+static size_t mi_os_read_size(const char* fname, size_t default_value) {
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0) return default_value;
+  char buf[32];
+  ssize_t nread = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (nread <= 0) return default_value;
+  size_t value = 0;
+  for (ssize_t i = 0; i < nread && buf[i] >= '0' && buf[i] <= '9'; i++) {
+    value = 10*value + (size_t)(buf[i] - '0');
+  }
+  return (value == 0 ? default_value : value);
+}
+
+// count the lines in `/proc/self/maps` (without allocating)
+static size_t mi_os_count_mappings(void) {
+  int fd = open("/proc/self/maps", O_RDONLY);
+  if (fd < 0) return 0;
+  size_t count = 0;
+  char buf[4096];
+  ssize_t nread;
+  while ((nread = read(fd, buf, sizeof(buf))) > 0) {
+    for (ssize_t i = 0; i < nread; i++) {
+      if (buf[i] == '\n') count++;
+    }
+  }
+  close(fd);
+  return count;
+}
+
+// Return the number of mappings (possibly a few seconds out of date unless `force` is set)
+// and the maximum number of mappings in `max`.
+size_t _mi_os_vma_count(bool force, size_t* max) {
+  size_t vmax = mi_atomic_load_relaxed(&mi_vma_max);
+  if (vmax == 0) {
+    vmax = mi_os_read_size("/proc/sys/vm/max_map_count", 65530);
+    mi_atomic_store_release(&mi_vma_max, vmax);
+  }
+  if (max != NULL) *max = vmax;
+  const mi_msecs_t now = _mi_clock_now();
+  mi_msecs_t expire = mi_atomic_load_relaxed(&mi_vma_count_expire);
+  if ((force || now >= expire) && mi_atomic_cas_strong_acq_rel(&mi_vma_count_expire, &expire, now + MI_VMA_COUNT_INTERVAL)) {
+    const size_t count = mi_os_count_mappings();
+    mi_atomic_store_release(&mi_vma_count, count);
+    if (count >= vmax/2 && mi_atomic_exchange_acq_rel(&mi_vma_pressure, 1) == 0) {
+      _mi_warning_message("the process uses %zu of at most %zu memory mappings; mimalloc stops splitting mappings from now on\n"
+                          "  (the limit is controlled by vm.max_map_count)\n", count, vmax);
+    }
+  }
+  return mi_atomic_load_acquire(&mi_vma_count);
+}
+
+// Are we close to running out of mappings? (once true, it stays true)
+static bool mi_os_vma_pressure(void) {
+  if (mi_atomic_load_relaxed(&mi_vma_pressure) != 0) return true;
+  _mi_os_vma_count(false, NULL);
+  return (mi_atomic_load_relaxed(&mi_vma_pressure) != 0);
+}
+
+// Reserve uncommitted memory as read/write so committing part of it does not split the mapping.
+// We only do this with overcommit (so `MAP_NORESERVE` is honored) and in debug or
+// secure mode only under pressure as otherwise we like to trap on access to uncommitted memory.
+static bool mi_os_reserve_accessible(void) {
+  if (!_mi_os_has_overcommit()) return false;
+  return (MI_DEBUG == 0 && MI_SECURE == 0) || mi_os_vma_pressure();
+}
+
+#else
+size_t _mi_os_vma_count(bool force, size_t* max) {
+  MI_UNUSED(force);
+  if (max != NULL) *max = 0;
+  return 0;
+}
+#endif
+
+
 /* -----------------------------------------------------------
    Primitive allocation from the OS.
 -------------------------------------------------------------- */
@@ -736,6 +853,9 @@ static void* mi_os_mem_alloc(size_t size, size_t try_alignment, bool commit, boo
     p = mi_heap_grow(size, try_alignment);
   #else
     int protect_flags = (commit ? (PROT_WRITE | PROT_READ) : PROT_NONE);
+    #if defined(MI_OS_TRACK_VMA)
+    if (!commit && mi_os_reserve_accessible()) { protect_flags = (PROT_WRITE | PROT_READ); }  // commit will not split the mapping
+    #endif
     p = mi_unix_mmap(NULL, size, try_alignment, protect_flags, false, allow_large, is_large);
   #endif
   mi_stat_counter_increase(stats->mmap_calls, 1);
@@ -764,7 +884,13 @@ static void* mi_os_mem_alloc_aligned(size_t size, size_t alignment, bool commit,
   // if not aligned, free it, overallocate, and unmap around it
   if (((uintptr_t)p % alignment != 0)) {
     mi_os_mem_free(p, size, commit, stats);
-    _mi_warning_message("unable to allocate aligned OS memory directly, fall back to over-allocation (%zu bytes, address: %p, alignment: %zu, commit: %d)\n", size, p, alignment, commit);
+    if (size > 1*MI_GiB) {
+      // expected as we do not use aligned hints for large sizes (see `mi_os_get_aligned_hint`)
+      _mi_verbose_message("over-allocating to align OS memory (%zu bytes, address: %p, alignment: %zu, commit: %d)\n", size, p, alignment, commit);
+    }
+    else {
+      _mi_warning_message("unable to allocate aligned OS memory directly, fall back to over-allocation (%zu bytes, address: %p, alignment: %zu, commit: %d)\n", size, p, alignment, commit);
+    }
     if (size >= (SIZE_MAX - alignment)) return NULL; // overflow
     const size_t over_size = size + alignment;
 
@@ -943,9 +1069,18 @@ static bool mi_os_commitx(void* addr, size_t size, bool commit, bool conservativ
     // (on the other hand, MADV_FREE would be good enough.. it is just not reflected in the stats :-( )
     err = madvise(start, csize, MADV_DONTNEED);
     #else
-    // decommit: just disable access (also used in debug and secure mode to trap on illegal access)
-    err = mprotect(start, csize, PROT_NONE);
-    if (err != 0) { err = errno; }
+    #if defined(MADV_DONTNEED) && defined(MI_OS_TRACK_VMA)
+    if (mi_os_vma_pressure()) {
+      // decommit: do not split the mapping when we are close to the `vm.max_map_count` limit
+      err = madvise(start, csize, MADV_DONTNEED);
+    }
+    else
+    #endif
+    {
+      // decommit: just disable access (also used in debug and secure mode to trap on illegal access)
+      err = mprotect(start, csize, PROT_NONE);
+      if (err != 0) { err = errno; }
+    }
     #endif
     //#if defined(MADV_FREE_REUSE)
     //  while ((err = mi_madvise(start, csize, MADV_FREE_REUSE)) != 0 && errno == EAGAIN) { errno = 0; }
@@ -1096,6 +1231,68 @@ bool _mi_os_unprotect(void* addr, size_t size) {
 }
 
 
+/* -----------------------------------------------------------
+  Exclude memory from a forked child process.
+  On `fork` the page tables of all mappings are copied which takes
+  long for large heaps. With `mode` 1 (`MADV_DONTFORK`) the child does
+  not get the range at all, and with `mode` 2 (`MADV_WIPEONFORK`) it
+  gets it zero filled. Since the child cannot use the excluded memory,
+  `_mi_fork_child` resets all heaps in the child on the first exclusion.
+  When this returns `false` the range is still present in the child: the
+  segment stays visible (see `segment.c:mi_segment_fork_track`) and is
+  abandoned in the child instead of forgotten.
+----------------------------------------------------------- */
+
+#if defined(MADV_DONTFORK) && defined(MI_USE_PTHREADS)
+static void mi_os_fork_register(void) {
+  static _Atomic(uintptr_t) registered; // = 0
+  uintptr_t expected = 0;
+  if (mi_atomic_load_relaxed(&registered) == 0 && mi_atomic_cas_strong_acq_rel(&registered, &expected, 1)) {
+    pthread_atfork(NULL, NULL, &_mi_fork_child);
+  }
+}
+
+bool _mi_os_exclude_from_fork(void* addr, size_t size, int mode, bool exclude) {
+  size_t csize = 0;
+  void* start = mi_os_page_align_area_conservative(addr, size, &csize);
+  if (csize == 0 || mode <= 0) return false;
+  #if defined(MI_OS_TRACK_VMA)
+  if (exclude && mi_os_vma_pressure()) {
+    // changing the advice splits the mapping; the segment stays visible in a forked child
+    static _Atomic(uintptr_t) warned; // = 0
+    if (mi_atomic_exchange_acq_rel(&warned, 1) == 0) {
+      _mi_verbose_message("near the mapping limit: new segments are no longer excluded from a fork\n");
+    }
+    return false;
+  }
+  #endif
+  int advice;
+  if (mode == 1) {
+    advice = (exclude ? MADV_DONTFORK : MADV_DOFORK);
+  }
+  else {
+    #if defined(MADV_WIPEONFORK)
+    advice = (exclude ? MADV_WIPEONFORK : MADV_KEEPONFORK);
+    #else
+    return false;
+    #endif
+  }
+  if (exclude) mi_os_fork_register();  // before the memory is excluded
+  const int err = mi_madvise(start, csize, advice);
+  if (err != 0) {
+    _mi_warning_message("madvise fork exclusion error: start: %p, csize: 0x%zx, errno: %i\n", start, csize, errno);
+    return false;
+  }
+  return true;
+}
+#else
+bool _mi_os_exclude_from_fork(void* addr, size_t size, int mode, bool exclude) {
+  MI_UNUSED(addr); MI_UNUSED(size); MI_UNUSED(mode); MI_UNUSED(exclude);
+  return false;
+}
+#endif
+
+
 
 bool _mi_os_shrink(void* p, size_t oldsize, size_t newsize, mi_stats_t* stats) {
   // page align conservatively within the range
@@ -42,7 +42,7 @@ static inline bool mi_page_queue_is_full(const mi_page_queue_t* pq) {
 }
 
 static inline bool mi_page_queue_is_special(const mi_page_queue_t* pq) {
-  return (pq->block_size > MI_MEDIUM_OBJ_SIZE_MAX);
+  return (mi_page_queue_is_huge(pq) || mi_page_queue_is_full(pq));
 }
 
 /* -----------------------------------------------------------
@@ -72,7 +72,7 @@ static inline uint8_t mi_bin(size_t size) {
     bin = (uint8_t)wsize;
   }
   #endif
-  else if (wsize > MI_MEDIUM_OBJ_WSIZE_MAX) {
+  else if (wsize > MI_LARGE_BIN_OBJ_WSIZE_MAX) {
     bin = MI_BIN_HUGE;
   }
   else {
@@ -108,9 +108,12 @@ size_t _mi_bin_size(uint8_t bin) {
 
 // Good size for allocation
 size_t mi_good_size(size_t size) mi_attr_noexcept {
-  if (size <= MI_MEDIUM_OBJ_SIZE_MAX) {
+  if (size <= MI_LARGE_BIN_OBJ_SIZE_MAX) {
     return _mi_bin_size(mi_bin(size));
   }
+  else if (size <= MI_LARGE_OBJ_SIZE_MAX) {
+    return _mi_align_up(size,MI_SEGMENT_SLICE_SIZE);
+  }
   else {
     return _mi_align_up(size,_mi_os_page_size());
   }
@@ -203,12 +206,115 @@ static bool mi_page_queue_is_empty(mi_page_queue_t* queue) {
 }
 */
 
+/* -----------------------------------------------------------
+  Huge pages (in a huge segment) that are freed by another thread
+  are unlinked by that thread from the huge queue of the owning heap
+  so the segment can be freed right away (see `_mi_page_huge_unlink`).
+  The huge queue is therefore only changed while holding the heap
+  `huge_lock`, and other threads do not unlink pages while the heap
+  visits its pages (`huge_pinned`).
+----------------------------------------------------------- */
+
+static void mi_heap_huge_lock(mi_heap_t* heap) {
+  while (mi_atomic_exchange_acq_rel(&heap->huge_lock, true)) {
+    mi_atomic_yield();
+  }
+}
+
+static void mi_heap_huge_unlock(mi_heap_t* heap) {
+  mi_atomic_store_release(&heap->huge_lock, false);
+}
+
+// Lock the heap if `queue` is its huge queue; returns `true` if locked.
+static inline bool mi_page_queue_lock(mi_heap_t* heap, const mi_page_queue_t* queue) {
+  if (mi_likely(!mi_page_queue_is_huge(queue))) return false;
+  mi_heap_huge_lock(heap);
+  return true;
+}
+
+static inline void mi_page_queue_unlock(mi_heap_t* heap, bool locked) {
+  if (locked) mi_heap_huge_unlock(heap);
+}
+
+// Called by the owning heap (or a thread that iterates it) before and after visiting its
+// pages. The owner also takes the huge pages unlinked by other threads off its page count.
+void _mi_heap_huge_pin(mi_heap_t* heap, bool pin) {
+  mi_heap_huge_lock(heap);
+  if (pin) {
+    heap->huge_pinned++;
+  }
+  else {
+    mi_assert_internal(heap->huge_pinned > 0);
+    heap->huge_pinned--;
+  }
+  if (heap->thread_id == _mi_thread_id()) {
+    mi_assert_internal(heap->page_count >= heap->huge_freed);
+    heap->page_count -= heap->huge_freed;
+    heap->huge_freed = 0;
+  }
+  mi_heap_huge_unlock(heap);
+}
+
+// Unlink a huge page from the huge queue of its owning heap on a free from another thread.
+// Returns `false` if that is not possible right now; the owning heap then frees the page.
+bool _mi_page_huge_unlink(mi_page_t* page) {
+  mi_assert_internal(page->used == 1);
+  // set `MI_DELAYED_FREEING` so the owning heap stays valid while we access it (see `mi_heap_delete`)
+  mi_thread_free_t tfree = mi_atomic_load_relaxed(&page->xthread_free);
+  do {
+    if (mi_tf_delayed(tfree) != MI_USE_DELAYED_FREE) return false;  // the owning heap is being deleted or abandoned
+  } while (!mi_atomic_cas_weak_acq_rel(&page->xthread_free, &tfree, mi_tf_set_delayed(tfree, MI_DELAYED_FREEING)));
+
+  bool unlinked = false;
+  mi_heap_t* const heap = mi_page_heap(page);
+  if (heap != NULL) {
+    mi_heap_huge_lock(heap);
+    mi_page_queue_t* const pq = &heap->pages[MI_BIN_HUGE];
+    // the page may be in transit to another heap (see `_mi_page_queue_transfer` and `mi_heap_absorb`)
+    if (heap->huge_pinned == 0 && mi_page_heap(page) == heap && !mi_page_is_in_full(page) &&
+        (page->prev != NULL || pq->first == page)) {
+      if (page->prev != NULL) page->prev->next = page->next;
+      if (page->next != NULL) page->next->prev = page->prev;
+      if (page == pq->last)  pq->last = page->prev;
+      if (page == pq->first) pq->first = page->next;
+      page->next = NULL;
+      page->prev = NULL;
+      heap->huge_freed++;  // the owner adjusts its `page_count` (see `_mi_heap_huge_pin`)
+      unlinked = true;
+    }
+    mi_heap_huge_unlock(heap);
+  }
+
+  // and reset the `MI_DELAYED_FREEING` flag
+  tfree = mi_atomic_load_relaxed(&page->xthread_free);
+  mi_thread_free_t tfreex;
+  do {
+    mi_assert_internal(mi_tf_delayed(tfree) == MI_DELAYED_FREEING);
+    tfreex = mi_tf_set_delayed(tfree, MI_USE_DELAYED_FREE);
+  } while (!mi_atomic_cas_weak_release(&page->xthread_free, &tfree, tfreex));
+  return unlinked;
+}
+
+
+// Retired pages are counted per bin (see `_mi_page_retire`) as they can end up
+// anywhere in the queue; a page is no longer retired once it leaves its queue.
+static inline void mi_page_queue_unretire(mi_heap_t* heap, mi_page_queue_t* queue, mi_page_t* page) {
+  if (mi_unlikely(page->retire_expire != 0)) {
+    mi_assert_internal(queue >= heap->pages && queue < &heap->pages[MI_BIN_HUGE]);
+    mi_page_retire_t* const pr = &heap->page_retire[queue - heap->pages];
+    mi_assert_internal(pr->retired > 0);
+    if (pr->retired > 0) pr->retired--;
+    page->retire_expire = 0;
+  }
+}
+
 static void mi_page_queue_remove(mi_page_queue_t* queue, mi_page_t* page) {
   mi_assert_internal(page != NULL);
   mi_assert_expensive(mi_page_queue_contains(queue, page));
   mi_assert_internal(page->xblock_size == queue->block_size || (page->xblock_size > MI_MEDIUM_OBJ_SIZE_MAX && mi_page_queue_is_huge(queue))  || (mi_page_is_in_full(page) && mi_page_queue_is_full(queue)));
   mi_heap_t* heap = mi_page_heap(page);
-
+  mi_page_queue_unretire(heap, queue, page);
+  const bool locked = mi_page_queue_lock(heap, queue);
   if (page->prev != NULL) page->prev->next = page->next;
   if (page->next != NULL) page->next->prev = page->prev;
   if (page == queue->last)  queue->last = page->prev;
@@ -221,6 +327,7 @@ static void mi_page_queue_remove(mi_page_queue_t* queue, mi_page_t* page) {
   heap->page_count--;
   page->next = NULL;
   page->prev = NULL;
+  mi_page_queue_unlock(heap, locked);
   // mi_atomic_store_ptr_release(mi_atomic_cast(void*, &page->heap), NULL);
   mi_page_set_in_full(page,false);
 }
@@ -229,14 +336,13 @@ static void mi_page_queue_remove(mi_page_queue_t* queue, mi_page_t* page) {
 static void mi_page_queue_push(mi_heap_t* heap, mi_page_queue_t* queue, mi_page_t* page) {
   mi_assert_internal(mi_page_heap(page) == heap);
   mi_assert_internal(!mi_page_queue_contains(queue, page));
-
-  mi_assert_internal(_mi_page_segment(page)->kind != MI_SEGMENT_HUGE);
   mi_assert_internal(page->xblock_size == queue->block_size ||
                       (page->xblock_size > MI_MEDIUM_OBJ_SIZE_MAX) ||
                         (mi_page_is_in_full(page) && mi_page_queue_is_full(queue)));
 
   mi_page_set_in_full(page, mi_page_queue_is_full(queue));
   // mi_atomic_store_ptr_release(mi_atomic_cast(void*, &page->heap), heap);
+  const bool locked = mi_page_queue_lock(heap, queue);
   page->next = queue->first;
   page->prev = NULL;
   if (queue->first != NULL) {
@@ -251,10 +357,20 @@ static void mi_page_queue_push(mi_heap_t* heap, mi_page_queue_t* queue, mi_page_
   // update direct
   mi_heap_queue_first_update(heap, queue);
   heap->page_count++;
+  mi_page_queue_unlock(heap, locked);
+}
+
+static void mi_page_queue_move_to_front(mi_heap_t* heap, mi_page_queue_t* queue, mi_page_t* page) {
+  mi_assert_internal(mi_page_heap(page) == heap);
+  mi_assert_expensive(mi_page_queue_contains(queue, page));
+  if (queue->first == page) return;
+  mi_page_queue_remove(queue, page);
+  mi_page_queue_push(heap, queue, page);
+  mi_assert_internal(queue->first == page);
 }
 
 
-static void mi_page_queue_enqueue_from(mi_page_queue_t* to, mi_page_queue_t* from, mi_page_t* page) {
+static void mi_page_queue_enqueue_from_ex(mi_page_queue_t* to, mi_page_queue_t* from, bool enqueue_at_end, mi_page_t* page) {
   mi_assert_internal(page != NULL);
   mi_assert_expensive(mi_page_queue_contains(from, page));
   mi_assert_expensive(!mi_page_queue_contains(to, page));
@@ -266,6 +382,8 @@ static void mi_page_queue_enqueue_from(mi_page_queue_t* to, mi_page_queue_t* fro
                      (page->xblock_size > MI_LARGE_OBJ_SIZE_MAX && mi_page_queue_is_full(to)));
 
   mi_heap_t* heap = mi_page_heap(page);
+  mi_page_queue_unretire(heap, from, page);
+  const bool locked = (mi_page_queue_lock(heap, from) || mi_page_queue_lock(heap, to));
   if (page->prev != NULL) page->prev->next = page->next;
   if (page->next != NULL) page->next->prev = page->prev;
   if (page == from->last)  from->last = page->prev;
@@ -276,20 +394,66 @@ static void mi_page_queue_enqueue_from(mi_page_queue_t* to, mi_page_queue_t* fro
     mi_heap_queue_first_update(heap, from);
   }
 
-  page->prev = to->last;
-  page->next = NULL;
-  if (to->last != NULL) {
-    mi_assert_internal(heap == mi_page_heap(to->last));
-    to->last->next = page;
-    to->last = page;
+  if (enqueue_at_end) {
+    page->prev = to->last;
+    page->next = NULL;
+    if (to->last != NULL) {
+      mi_assert_internal(heap == mi_page_heap(to->last));
+      to->last->next = page;
+      to->last = page;
+    }
+    else {
+      to->first = page;
+      to->last = page;
+      mi_heap_queue_first_update(heap, to);
+    }
   }
   else {
-    to->first = page;
-    to->last = page;
+    page->prev = NULL;
+    page->next = to->first;
+    if (to->first != NULL) {
+      mi_assert_internal(heap == mi_page_heap(to->first));
+      to->first->prev = page;
+      to->first = page;
+    }
+    else {
+      to->first = page;
+      to->last = page;
+    }
     mi_heap_queue_first_update(heap, to);
   }
 
   mi_page_set_in_full(page, mi_page_queue_is_full(to));
+  mi_page_queue_unlock(heap, locked);
+}
+
+static void mi_page_queue_enqueue_from(mi_page_queue_t* to, mi_page_queue_t* from, mi_page_t* page) {
+  mi_page_queue_enqueue_from_ex(to, from, true /* at the end */, page);
+}
+
+// Move a page from the full queue back to the front of its regular queue; such
+// pages just had blocks freed (usually by other threads) and are the best
+// candidates for the next allocation.
+static void mi_page_queue_enqueue_from_full(mi_page_queue_t* to, mi_page_queue_t* from, mi_page_t* page) {
+  mi_assert_internal(mi_page_queue_is_full(from));
+  mi_page_queue_enqueue_from_ex(to, from, false /* at the front */, page);
+}
+
+// Move a single page to the corresponding queue of another heap of the same thread.
+// Only called from `mi_heap_adopt_page`.
+void _mi_page_queue_transfer(mi_heap_t* heap, mi_page_t* page) {
+  mi_heap_t* const from = mi_page_heap(page);
+  mi_assert_internal(from != NULL && from != heap && from->tld == heap->tld);
+  mi_page_queue_t* const pq = mi_page_queue_of(page);
+  mi_page_queue_t* const to = &heap->pages[pq - from->pages];
+  mi_page_queue_remove(pq, page);
+  // as in `_mi_page_queue_append`: after waiting for any DELAYED_FREEING to finish
+  // only the new heap is used for delayed free operations.
+  mi_atomic_store_release(&page->xheap, (uintptr_t)heap);
+  while (mi_page_thread_free_flag(page) == MI_DELAYED_FREEING) {
+    mi_atomic_yield();
+  }
+  mi_page_queue_push(heap, to, page);
 }
 
 // Only called from `mi_heap_absorb`.
@@ -305,13 +469,17 @@ size_t _mi_page_queue_append(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_queue
     // inline `mi_page_set_heap` to avoid wrong assertion during absorption;
     // in this case it is ok to be delayed freeing since both "to" and "from" heap are still alive.
     mi_atomic_store_release(&page->xheap, (uintptr_t)heap); 
-    // set the flag to delayed free (not overriding NEVER_DELAYED_FREE) which has as a
-    // side effect that it spins until any DELAYED_FREEING is finished. This ensures
-    // that after appending only the new heap will be used for delayed free operations.
-    _mi_page_use_delayed_free(page, MI_USE_DELAYED_FREE, false);
+    page->retire_expire = 0;  // retired pages are only counted in their original heap
+    // wait until any DELAYED_FREEING is finished. This ensures that after appending only
+    // the new heap will be used for delayed free operations. (We cannot reset the flag
+    // here as the page may still be in the `from` heap `thread_delayed_pages` list.)
+    while (mi_page_thread_free_flag(page) == MI_DELAYED_FREEING) {
+      mi_atomic_yield();
+    }
     count++;
   }
 
+  const bool locked = mi_page_queue_lock(heap, pq);  // both heaps are pinned (see `mi_heap_absorb`)
   if (pq->last==NULL) {
     // take over afresh
     mi_assert_internal(pq->first==NULL);
@@ -327,5 +495,6 @@ size_t _mi_page_queue_append(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_queue
     append->first->prev = pq->last;
     pq->last = append->last;
   }
+  mi_page_queue_unlock(heap, locked);
   return count;
 }
@@ -29,48 +29,6 @@ terms of the MIT license. A copy of the license can be found in the file
   Page helpers
 ----------------------------------------------------------- */
 
-static mi_decl_cache_align _Atomic(bool) lock_detached_page_queue; // = 0
-mi_detached_page_queue_t                 detached_page_queue;      // = NULL
-
-void _mi_page_lock_detached_page_queue(void) {
-  while (mi_atomic_exchange_acq_rel(&lock_detached_page_queue, true)) {
-    mi_atomic_yield();
-  }
-}
-
-void _mi_page_unlock_detached_page_queue(void) {
-  mi_atomic_store_release(&lock_detached_page_queue, false);
-}
-
-void _mi_page_add_detached_page(mi_page_t* page) {
-  _mi_page_lock_detached_page_queue();
-
-  if (detached_page_queue.last == NULL) {
-    mi_assert_internal(detached_page_queue.first == NULL);
-    detached_page_queue.first = page;
-    detached_page_queue.last = page;
-  } else {
-    mi_assert_internal(detached_page_queue.last != NULL);
-    mi_assert_internal(detached_page_queue.first != NULL);
-    detached_page_queue.last->next = page;
-    page->prev = detached_page_queue.last;
-    detached_page_queue.last = page;
-  }
-  _mi_page_unlock_detached_page_queue();
-}
-
-void _mi_page_remove_detached_page(mi_page_t* page) {
-  _mi_page_lock_detached_page_queue();
-  if (page->prev != NULL) page->prev->next = page->next;
-  if (page->next != NULL) page->next->prev = page->prev;
-  if (page == detached_page_queue.last)  detached_page_queue.last = page->prev;
-  if (page == detached_page_queue.first) detached_page_queue.first = page->next;
-
-  page->prev = NULL;
-  page->next = NULL;
-  _mi_page_unlock_detached_page_queue();
-}
-
 // Index a block in a page
 static inline mi_block_t* mi_page_block_at(const mi_page_t* page, void* page_start, size_t block_size, size_t i) {
   MI_UNUSED(page);
@@ -155,12 +113,10 @@ bool _mi_page_is_valid(mi_page_t* page) {
     mi_segment_t* segment = _mi_page_segment(page);
 
     mi_assert_internal(!_mi_process_is_initialized || segment->thread_id==0 || segment->thread_id == mi_page_heap(page)->thread_id);
-    if (segment->kind != MI_SEGMENT_HUGE) {
-      mi_page_queue_t* pq = mi_page_queue_of(page);
-      mi_assert_internal(mi_page_queue_contains(pq, page));
-      mi_assert_internal(pq->block_size==mi_page_block_size(page) || mi_page_block_size(page) > MI_MEDIUM_OBJ_SIZE_MAX || mi_page_is_in_full(page));
-      mi_assert_internal(mi_heap_contains_queue(mi_page_heap(page),pq));
-    }
+    mi_page_queue_t* pq = mi_page_queue_of(page);
+    mi_assert_internal(mi_page_queue_contains(pq, page));
+    mi_assert_internal(pq->block_size==mi_page_block_size(page) || mi_page_block_size(page) > MI_MEDIUM_OBJ_SIZE_MAX || mi_page_is_in_full(page));
+    mi_assert_internal(mi_heap_contains_queue(mi_page_heap(page),pq));
   }
   return true;
 }
@@ -224,6 +180,12 @@ static void _mi_page_thread_free_collect(mi_page_t* page)
     return; // the thread-free items cannot be freed
   }
 
+  #if MI_LIVE_BITS
+  for (mi_block_t* block = head; block != NULL; block = mi_block_next(page, block)) {
+    mi_block_clear_live(block);
+  }
+  #endif
+
   // and append the current local free list
   mi_block_set_next(page,tail, page->local_free);
   page->local_free = head;
@@ -271,13 +233,61 @@ void _mi_page_free_collect(mi_page_t* page, bool force) {
   Page fresh and retire
 ----------------------------------------------------------- */
 
+// Retire parameters
+#define MI_MAX_RETIRE_SIZE    MI_LARGE_BIN_OBJ_SIZE_MAX
+#define MI_RETIRE_CYCLES      (8)
+#define MI_RETIRE_KEEP_MAX    (4)    // maximal empty pages kept per bin
+
+// Adaptive retirement: each bin keeps a reuse score that is raised when a
+// retired page is allocated from again (or when a fresh page is needed shortly
+// after an empty page was freed), and lowered when a retired page expires unused.
+static inline mi_page_retire_t* mi_heap_page_retire(mi_heap_t* heap, const mi_page_queue_t* pq) {
+  mi_assert_internal(pq >= heap->pages && pq < &heap->pages[MI_BIN_HUGE]);
+  return &heap->page_retire[pq - heap->pages];
+}
+
+static void mi_page_retire_hit(mi_heap_t* heap, const mi_page_queue_t* pq) {
+  mi_page_retire_t* pr = mi_heap_page_retire(heap, pq);
+  if (pr->score < MI_RETIRE_KEEP_MAX) pr->score++;
+  mi_stat_counter_increase(_mi_stats_main.page_retire_hit, 1);
+}
+
+static void mi_page_retire_miss(mi_heap_t* heap, const mi_page_queue_t* pq) {
+  mi_page_retire_t* pr = mi_heap_page_retire(heap, pq);
+  if (pr->score > -1) pr->score--;
+}
+
+// an empty page of this bin is freed back to the segment
+static void mi_page_retire_freed(mi_heap_t* heap, const mi_page_queue_t* pq) {
+  mi_page_retire_t* pr = mi_heap_page_retire(heap, pq);
+  pr->freed_beat = (uint16_t)heap->tld->heartbeat;
+  pr->freed = true;
+}
+
+// a fresh page is needed for this bin; if an empty page was freed just
+// before, keeping it would have been better.
+static void mi_page_retire_fresh(mi_heap_t* heap, const mi_page_queue_t* pq) {
+  mi_page_retire_t* pr = mi_heap_page_retire(heap, pq);
+  if (pr->freed && (uint16_t)((uint16_t)heap->tld->heartbeat - pr->freed_beat) <= MI_RETIRE_CYCLES) {
+    if (pr->score < MI_RETIRE_KEEP_MAX) pr->score++;
+    pr->freed = false;
+  }
+}
+
+// a page with free blocks is picked for allocation
+static inline void mi_page_unretire(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_t* page) {
+  if (mi_unlikely(page->retire_expire != 0)) {
+    mi_page_retire_hit(heap, pq);
+    mi_page_queue_unretire(heap, pq, page);
+  }
+}
+
 // called from segments when reclaiming abandoned pages
 void _mi_page_reclaim(mi_heap_t* heap, mi_page_t* page) {
   mi_assert_expensive(mi_page_is_valid_init(page));
 
   mi_assert_internal(mi_page_heap(page) == heap);
   mi_assert_internal(mi_page_thread_free_flag(page) != MI_NEVER_DELAYED_FREE);
-  mi_assert_internal(_mi_page_segment(page)->kind != MI_SEGMENT_HUGE);
   mi_assert_internal(!page->is_reset);
   // TODO: push on full queue immediately if it is full?
   mi_page_queue_t* pq = mi_page_queue(heap, mi_page_block_size(page));
@@ -287,16 +297,15 @@ void _mi_page_reclaim(mi_heap_t* heap, mi_page_t* page) {
 
 // allocate a fresh page from a segment
 static mi_page_t* mi_page_fresh_alloc(mi_heap_t* heap, mi_page_queue_t* pq, size_t block_size) {
-  mi_assert_internal(pq==NULL||mi_heap_contains_queue(heap, pq));
+  mi_assert_internal(mi_heap_contains_queue(heap, pq));
   mi_page_t* page = _mi_segment_page_alloc(heap, block_size, &heap->tld->segments, &heap->tld->os);
   if (page == NULL) {
     // this may be out-of-memory, or an abandoned page was reclaimed (and in our queue)
     return NULL;
   }
-  mi_assert_internal(pq==NULL || _mi_page_segment(page)->kind != MI_SEGMENT_HUGE);
   mi_page_init(heap, page, block_size, heap->tld);
   mi_heap_stat_increase(heap, pages, 1);
-  if (pq!=NULL) mi_page_queue_push(heap, pq, page); // huge pages use pq==NULL
+  mi_page_queue_push(heap, pq, page);
   mi_assert_expensive(_mi_page_is_valid(page));
   return page;
 }
@@ -304,6 +313,7 @@ static mi_page_t* mi_page_fresh_alloc(mi_heap_t* heap, mi_page_queue_t* pq, size
 // Get a fresh page to use
 static mi_page_t* mi_page_fresh(mi_heap_t* heap, mi_page_queue_t* pq) {
   mi_assert_internal(mi_heap_contains_queue(heap, pq));
+  mi_page_retire_fresh(heap, pq);
   mi_page_t* page = mi_page_fresh_alloc(heap, pq, pq->block_size);
   if (page==NULL) return NULL;
   mi_assert_internal(pq->block_size==mi_page_block_size(page));
@@ -313,26 +323,42 @@ static mi_page_t* mi_page_fresh(mi_heap_t* heap, mi_page_queue_t* pq) {
 
 /* -----------------------------------------------------------
    Do any delayed frees
-   (put there by other threads if they deallocated in a full page)
+   (pages put there by other threads on their first free
+    since we last looked at the page)
 ----------------------------------------------------------- */
+static void mi_page_delayed_free(mi_page_t* page) {
+  mi_assert_internal(_mi_thread_id() == _mi_page_segment(page)->thread_id);
+
+  // Clear the no-delayed flag so delayed freeing is used again for this page.
+  // This must be done before collecting the free lists on this page -- otherwise
+  // some blocks may end up in the page `thread_free` list without the page being
+  // in the heap `thread_delayed_pages` list which may cause the page to be never freed!
+  // (it would only be freed if we happen to scan it in `mi_page_queue_find_free_ex`)
+  // Note: this waits for the freeing thread to finish its `MI_DELAYED_FREEING` phase.
+  _mi_page_use_delayed_free(page, MI_USE_DELAYED_FREE, false /* dont overwrite never delayed */);
+
+  // collect the non-local frees to ensure an up-to-date `used` count
+  _mi_page_free_collect(page, false);
+
+  // and retire the page, or move it out of the full queue as it has free blocks again
+  if (mi_page_all_free(page)) {
+    _mi_page_retire(page);
+  }
+  else if (mi_page_is_in_full(page) && page->used < page->capacity) {
+    _mi_page_unfull(page);
+  }
+}
+
 void _mi_heap_delayed_free(mi_heap_t* heap) {
   // take over the list (note: no atomic exchange since it is often NULL)
-  mi_block_t* block = mi_atomic_load_ptr_relaxed(mi_block_t, &heap->thread_delayed_free);
-  while (block != NULL && !mi_atomic_cas_ptr_weak_acq_rel(mi_block_t, &heap->thread_delayed_free, &block, NULL)) { /* nothing */ };
-
-  // and free them all
-  while(block != NULL) {
-    mi_block_t* next = mi_block_nextx(heap,block, heap->keys);
-    // use internal free instead of regular one to keep stats etc correct
-    if (!_mi_free_delayed_block(block)) {
-      // we might already start delayed freeing while another thread has not yet
-      // reset the delayed_freeing flag; in that case delay it further by reinserting.
-      mi_block_t* dfree = mi_atomic_load_ptr_relaxed(mi_block_t, &heap->thread_delayed_free);
-      do {
-        mi_block_set_nextx(heap, block, dfree, heap->keys);
-      } while (!mi_atomic_cas_ptr_weak_release(mi_block_t,&heap->thread_delayed_free, &dfree, block));
-    }
-    block = next;
+  mi_page_t* page = mi_atomic_load_ptr_relaxed(mi_page_t, &heap->thread_delayed_pages);
+  while (page != NULL && !mi_atomic_cas_ptr_weak_acq_rel(mi_page_t, &heap->thread_delayed_pages, &page, NULL)) { /* nothing */ };
+
+  // and process each page
+  while(page != NULL) {
+    mi_page_t* next = page->delayed_next;  // read first as the page can be pushed again or freed
+    mi_page_delayed_free(page);
+    page = next;
   }
 }
 
@@ -340,7 +366,8 @@ void _mi_heap_delayed_free(mi_heap_t* heap) {
   Unfull, abandon, free and retire
 ----------------------------------------------------------- */
 
-// Move a page from the full list back to a regular list
+// Move a page from the full list back to the front of its regular list
+// (it has free blocks again, usually freed by another thread)
 void _mi_page_unfull(mi_page_t* page) {
   mi_assert_internal(page != NULL);
   mi_assert_expensive(_mi_page_is_valid(page));
@@ -352,7 +379,7 @@ void _mi_page_unfull(mi_page_t* page) {
   mi_page_set_in_full(page, false); // to get the right queue
   mi_page_queue_t* pq = mi_heap_page_queue_of(heap, page);
   mi_page_set_in_full(page, true);
-  mi_page_queue_enqueue_from(pq, pqfull, page);
+  mi_page_queue_enqueue_from_full(pq, pqfull, page);
 }
 
 static void mi_page_to_full(mi_page_t* page, mi_page_queue_t* pq) {
@@ -368,7 +395,7 @@ static void mi_page_to_full(mi_page_t* page, mi_page_queue_t* pq) {
 
 // Abandon a page with used blocks at the end of a thread.
 // Note: only call if it is ensured that no references exist from
-// the `page->heap->thread_delayed_free` into this page.
+// the `page->heap->thread_delayed_pages` to this page.
 // Currently only called through `mi_heap_collect_ex` which ensures this.
 void _mi_page_abandon(mi_page_t* page, mi_page_queue_t* pq) {
   mi_assert_internal(page != NULL);
@@ -388,8 +415,8 @@ void _mi_page_abandon(mi_page_t* page, mi_page_queue_t* pq) {
 
 #if MI_DEBUG>1
   // check there are no references left..
-  for (mi_block_t* block = (mi_block_t*)pheap->thread_delayed_free; block != NULL; block = mi_block_nextx(pheap, block, pheap->keys)) {
-    mi_assert_internal(_mi_ptr_page(block) != page);
+  for (mi_page_t* dpage = mi_atomic_load_ptr_relaxed(mi_page_t, &pheap->thread_delayed_pages); dpage != NULL; dpage = dpage->delayed_next) {
+    mi_assert_internal(dpage != page);
   }
 #endif
 
@@ -405,7 +432,11 @@ void _mi_page_free(mi_page_t* page, mi_page_queue_t* pq, bool force) {
   mi_assert_expensive(_mi_page_is_valid(page));
   mi_assert_internal(pq == mi_page_queue_of(page));
   mi_assert_internal(mi_page_all_free(page));
-  mi_assert_internal(mi_page_thread_free_flag(page)!=MI_DELAYED_FREEING);
+
+  // a page that is (being) pushed on the heap `thread_delayed_pages` list cannot be freed yet;
+  // it is retired again once the heap processes that list (in `_mi_heap_delayed_free`).
+  const mi_delayed_t delayed = mi_page_thread_free_flag(page);
+  if (mi_unlikely(delayed == MI_DELAYED_FREEING || delayed == MI_NO_DELAYED_FREE)) return;
 
   // no more aligned blocks in here
   mi_page_set_has_aligned(page, false);
@@ -422,10 +453,6 @@ void _mi_page_free(mi_page_t* page, mi_page_queue_t* pq, bool force) {
   _mi_segment_page_free(page, force, segments_tld);
 }
 
-// Retire parameters
-#define MI_MAX_RETIRE_SIZE    MI_MEDIUM_OBJ_SIZE_MAX  
-#define MI_RETIRE_CYCLES      (8)
-
 // Retire a page with no more used blocks
 // Important to not retire too quickly though as new
 // allocations might coming.
@@ -441,51 +468,76 @@ void _mi_page_retire(mi_page_t* page) mi_attr_noexcept {
 
   // don't retire too often..
   // (or we end up retiring and re-allocating most of the time)
-  // NOTE: refine this more: we should not retire if this
-  // is the only page left with free blocks. It is not clear
-  // how to check this efficiently though...
-  // for now, we don't retire if it is the only page left of this size class.
+  // By default we only keep the page if it is the only page left of this size class;
+  // the per-bin reuse score adapts this: bins where retired pages are reused
+  // keep up to `MI_RETIRE_KEEP_MAX` empty pages, and bins where they expire unused keep none.
   mi_page_queue_t* pq = mi_page_queue_of(page);
   if (mi_likely(page->xblock_size <= MI_MAX_RETIRE_SIZE && !mi_page_is_in_full(page))) {
-    if (pq->last==page && pq->first==page) { // the only page in the queue?
+    mi_heap_t* heap = mi_page_heap(page);
+    mi_assert_internal(pq >= heap->pages);
+    const size_t index = pq - heap->pages;
+    mi_assert_internal(index < MI_BIN_FULL && index < MI_BIN_HUGE);
+    mi_page_unretire(heap, pq, page);  // retired before and allocated from since
+    mi_page_retire_t* const pr = &heap->page_retire[index];
+    bool keep;
+    if (pr->score <= 0) {
+      keep = (pr->score == 0 && pq->last==page && pq->first==page); // the only page in the queue?
+    }
+    else {
+      keep = (pr->retired < pr->score);
+    }
+    if (keep) {
       mi_stat_counter_increase(_mi_stats_main.page_no_retire,1);
-      page->retire_expire = 1 + (page->xblock_size <= MI_SMALL_OBJ_SIZE_MAX ? MI_RETIRE_CYCLES : MI_RETIRE_CYCLES/4);      
-      mi_heap_t* heap = mi_page_heap(page);
-      mi_assert_internal(pq >= heap->pages);
-      const size_t index = pq - heap->pages;
-      mi_assert_internal(index < MI_BIN_FULL && index < MI_BIN_HUGE);
+      mi_page_queue_move_to_front(heap, pq, page);
+      page->retire_expire = 1 + (page->xblock_size <= MI_SMALL_OBJ_SIZE_MAX ? MI_RETIRE_CYCLES : MI_RETIRE_CYCLES/4);
+      pr->retired++;
       if (index < heap->page_retired_min) heap->page_retired_min = index;
       if (index > heap->page_retired_max) heap->page_retired_max = index;
       mi_assert_internal(mi_page_all_free(page));
       return; // dont't free after all
     }
+    mi_page_retire_freed(heap, pq);
   }
   _mi_page_free(page, pq, false);
 }
 
-// free retired pages: we don't need to look at the entire queues
-// since we only retire pages that are at the head position in a queue.
+// free retired pages: retired pages are moved to the front of a queue but
+// other pages can be pushed in front of them later on, so we search each queue
+// until all its retired pages (as counted in `page_retire[bin].retired`) are visited.
 void _mi_heap_collect_retired(mi_heap_t* heap, bool force) {
   size_t min = MI_BIN_FULL;
   size_t max = 0;
   for(size_t bin = heap->page_retired_min; bin <= heap->page_retired_max; bin++) {
-    mi_page_queue_t* pq   = &heap->pages[bin];
-    mi_page_t*       page = pq->first;
-    if (page != NULL && page->retire_expire != 0) {
-      if (mi_page_all_free(page)) {
-        page->retire_expire--;
-        if (force || page->retire_expire == 0) {
-          _mi_page_free(pq->first, pq, force);
+    mi_page_queue_t*  pq   = &heap->pages[bin];
+    mi_page_retire_t* pr   = &heap->page_retire[bin];
+    mi_page_t*        page = pq->first;
+    size_t remaining = pr->retired;
+    while (page != NULL && remaining > 0) {
+      mi_page_t* next = page->next; // remember next as the page may be freed
+      if (page->retire_expire != 0) {
+        remaining--;
+        if (mi_page_all_free(page)) {
+          if (force || page->retire_expire <= 1) {
+            if (!force) {
+              mi_page_retire_miss(heap, pq);
+              mi_page_retire_freed(heap, pq);
+            }
+            _mi_page_free(page, pq, force);  // stays retired if it cannot be freed yet
+          }
+          else {
+            page->retire_expire--;
+          }
         }
         else {
-          // keep retired, update min/max
-          if (bin < min) min = bin;
-          if (bin > max) max = bin;
+          mi_page_unretire(heap, pq, page);
         }
       }
-      else {
-        page->retire_expire = 0;
-      }
+      page = next;
+    }
+    if (pr->retired > 0) {
+      // keep retired, update min/max
+      if (bin < min) min = bin;
+      if (bin > max) max = bin;
     }
   }
   heap->page_retired_min = min;
@@ -703,6 +755,12 @@ static void mi_page_init(mi_heap_t* heap, mi_page_t* page, size_t block_size, mi
   Find pages with free blocks
 -------------------------------------------------------------*/
 
+// Maximal number of pages visited in one search before we allocate a fresh page.
+// Pages that became non-full through (remote) frees are put at the front of their
+// queue (see `_mi_page_unfull`), so pages with available blocks are found early and
+// the remaining (full) pages are moved out of the queue over subsequent searches.
+#define MI_MAX_PAGE_SEARCH  (16)
+
 // Find a page with free blocks of `page->block_size`.
 static mi_page_t* mi_page_queue_find_free_ex(mi_heap_t* heap, mi_page_queue_t* pq, bool first_try)
 {
@@ -711,6 +769,10 @@ static mi_page_t* mi_page_queue_find_free_ex(mi_heap_t* heap, mi_page_queue_t* p
   mi_page_t* page = pq->first;
   while (page != NULL)
   {
+    if (count >= MI_MAX_PAGE_SEARCH) {
+      page = NULL;  // search budget exhausted
+      break;
+    }
     mi_page_t* next = page->next; // remember next
     count++;
 
@@ -749,7 +811,7 @@ static mi_page_t* mi_page_queue_find_free_ex(mi_heap_t* heap, mi_page_queue_t* p
   }
   else {
     mi_assert(pq->first == page);
-    page->retire_expire = 0;
+    mi_page_unretire(heap, pq, page);
   }
   mi_assert_internal(page == NULL || mi_page_immediate_available(page));
   return page;
@@ -774,7 +836,7 @@ static inline mi_page_t* mi_find_free_page(mi_heap_t* heap, size_t size) {
     }
     
     if (mi_page_immediate_available(page)) {
-      page->retire_expire = 0;
+      mi_page_unretire(heap, pq, page);
       return page; // fast path
     }
   }
@@ -792,11 +854,92 @@ static inline mi_page_t* mi_find_free_page(mi_heap_t* heap, size_t size) {
 static mi_deferred_free_fun* volatile deferred_free = NULL;
 static _Atomic(void*) deferred_arg; // = NULL
 
+// Besides the single legacy function, multiple subscribers can register with
+// `mi_register_deferred_free_ex`. Each is called every `frequency` heartbeats of
+// a thread with information about the memory pressure and a time budget. A subscriber
+// that overruns its budget is called less often (up to `MI_DEFERRED_BACKOFF_MAX`
+// doublings of its frequency) until it stays within its budget again.
+//
+// A registration is an immutable record that is published with a single atomic pointer
+// so a caller always sees a matching function and argument. An unregistered record is
+// only reused once no thread is calling subscribers (`deferred_subs_active`).
+#define MI_DEFERRED_FREE_MAX      (8)
+#define MI_DEFERRED_BACKOFF_MAX   (8)
+
+typedef struct mi_deferred_free_rec_s {
+  mi_deferred_free_ex_fun*       fn;
+  void*                          arg;
+  size_t                         frequency;
+  long                           budget_msecs;
+  struct mi_deferred_free_rec_s* next;     // in `deferred_recs_free` once unregistered
+} mi_deferred_free_rec_t;
+
+typedef struct mi_deferred_free_sub_s {
+  _Atomic(mi_deferred_free_rec_t*) rec;   // NULL if the slot is free
+  _Atomic(size_t) backoff;                // frequency is shifted by this amount after overruns
+} mi_deferred_free_sub_t;
+
+static mi_deferred_free_sub_t deferred_subs[MI_DEFERRED_FREE_MAX];  // = 0
+static _Atomic(size_t) deferred_subs_count;                          // = 0
+static _Atomic(size_t) deferred_subs_active;                         // = 0; threads calling subscribers
+static mi_deferred_free_rec_t* deferred_recs_free;                   // = NULL; protected by the lock
+static mi_decl_cache_align _Atomic(bool) deferred_subs_lock;         // = 0; only for (un)registration
+
+static void mi_deferred_subs_lock(void) {
+  while (mi_atomic_exchange_acq_rel(&deferred_subs_lock, true)) {
+    mi_atomic_yield();
+  }
+}
+
+static void mi_deferred_subs_unlock(void) {
+  mi_atomic_store_release(&deferred_subs_lock, false);
+}
+
+static mi_decl_noinline void mi_deferred_free_subscribers(mi_heap_t* heap, bool force) {
+  mi_deferred_free_info_t info;
+  info.force = force;
+  info.heartbeat = heap->tld->heartbeat;
+  info.committed = (size_t)_mi_stats_main.committed.current;      // racy read but ok as a hint
+  info.peak_committed = (size_t)_mi_stats_main.committed.peak;
+  const long limit = mi_option_get(mi_option_commit_limit);
+  info.commit_limit = (limit <= 0 ? 0 : (size_t)limit * MI_MiB);
+  mi_atomic_increment_acq_rel(&deferred_subs_active);  // before reading any record
+  for (size_t i = 0; i < MI_DEFERRED_FREE_MAX; i++) {
+    mi_deferred_free_sub_t* sub = &deferred_subs[i];
+    const mi_deferred_free_rec_t* rec = mi_atomic_load_ptr_acquire(mi_deferred_free_rec_t, &sub->rec);
+    if (rec == NULL) continue;
+    const size_t backoff = mi_atomic_load_relaxed(&sub->backoff);
+    const size_t frequency = rec->frequency << backoff;
+    if (!force && frequency > 1 && (info.heartbeat % frequency) != 0) continue;
+    info.budget_msecs = rec->budget_msecs;
+    if (info.budget_msecs <= 0) {
+      rec->fn(&info, rec->arg);
+    }
+    else {
+      const mi_msecs_t start = _mi_clock_now();
+      rec->fn(&info, rec->arg);
+      const bool overrun = (_mi_clock_now() - start > info.budget_msecs);
+      if (overrun && backoff < MI_DEFERRED_BACKOFF_MAX) {
+        mi_atomic_store_relaxed(&sub->backoff, backoff + 1);
+      }
+      else if (!overrun && backoff > 0) {
+        mi_atomic_store_relaxed(&sub->backoff, backoff - 1);
+      }
+    }
+  }
+  mi_atomic_decrement_acq_rel(&deferred_subs_active);
+}
+
 void _mi_deferred_free(mi_heap_t* heap, bool force) {
   heap->tld->heartbeat++;
-  if (deferred_free != NULL && !heap->tld->recurse) {
+  if (!heap->tld->recurse && (deferred_free != NULL || mi_atomic_load_relaxed(&deferred_subs_count) > 0)) {
     heap->tld->recurse = true;
-    deferred_free(force, heap->tld->heartbeat, mi_atomic_load_ptr_relaxed(void,&deferred_arg));
+    if (deferred_free != NULL) {
+      deferred_free(force, heap->tld->heartbeat, mi_atomic_load_ptr_relaxed(void,&deferred_arg));
+    }
+    if (mi_atomic_load_relaxed(&deferred_subs_count) > 0) {
+      mi_deferred_free_subscribers(heap, force);
+    }
     heap->tld->recurse = false;
   }
 }
@@ -806,37 +949,81 @@ void mi_register_deferred_free(mi_deferred_free_fun* fn, void* arg) mi_attr_noex
   mi_atomic_store_ptr_release(void,&deferred_arg, arg);
 }
 
+bool mi_register_deferred_free_ex(mi_deferred_free_ex_fun* fn, void* arg, size_t frequency, long budget_msecs) mi_attr_noexcept {
+  if (fn == NULL) return false;
+  bool registered = false;
+  mi_deferred_subs_lock();
+  for (size_t i = 0; i < MI_DEFERRED_FREE_MAX; i++) {
+    mi_deferred_free_sub_t* sub = &deferred_subs[i];
+    if (mi_atomic_load_ptr_relaxed(mi_deferred_free_rec_t, &sub->rec) == NULL) {
+      // reuse an unregistered record only if no thread can still be reading it
+      // (the read-modify-write orders this with the increment in `mi_deferred_free_subscribers`)
+      mi_deferred_free_rec_t* rec = NULL;
+      if (deferred_recs_free != NULL && mi_atomic_add_acq_rel(&deferred_subs_active, 0) == 0) {
+        rec = deferred_recs_free;
+        deferred_recs_free = rec->next;
+      }
+      else {
+        rec = (mi_deferred_free_rec_t*)_mi_os_alloc(sizeof(mi_deferred_free_rec_t), &_mi_stats_main);
+        if (rec == NULL) break;
+      }
+      rec->fn = fn;
+      rec->arg = arg;
+      rec->frequency = (frequency == 0 ? 1 : frequency);
+      rec->budget_msecs = budget_msecs;
+      rec->next = NULL;
+      mi_atomic_store_relaxed(&sub->backoff, (size_t)0);
+      mi_atomic_store_ptr_release(mi_deferred_free_rec_t, &sub->rec, rec);  // publish
+      mi_atomic_increment_relaxed(&deferred_subs_count);
+      registered = true;
+      break;
+    }
+  }
+  mi_deferred_subs_unlock();
+  if (!registered) {
+    _mi_warning_message("unable to register deferred free function: at most %d functions can be registered\n", MI_DEFERRED_FREE_MAX);
+  }
+  return registered;
+}
+
+void mi_unregister_deferred_free_ex(mi_deferred_free_ex_fun* fn, void* arg) mi_attr_noexcept {
+  if (fn == NULL) return;
+  mi_deferred_subs_lock();
+  for (size_t i = 0; i < MI_DEFERRED_FREE_MAX; i++) {
+    mi_deferred_free_sub_t* sub = &deferred_subs[i];
+    mi_deferred_free_rec_t* rec = mi_atomic_load_ptr_relaxed(mi_deferred_free_rec_t, &sub->rec);
+    if (rec != NULL && rec->fn == fn && rec->arg == arg) {
+      mi_atomic_store_ptr_release(mi_deferred_free_rec_t, &sub->rec, NULL);
+      mi_atomic_decrement_relaxed(&deferred_subs_count);
+      rec->next = deferred_recs_free;  // other threads may still be calling it
+      deferred_recs_free = rec;
+      break;
+    }
+  }
+  mi_deferred_subs_unlock();
+}
+
 
 /* -----------------------------------------------------------
   General allocation
 ----------------------------------------------------------- */
 
 // Large and huge page allocation.
-// Huge pages are allocated directly without being in a queue.
-// Because huge pages contain just one block, and the segment contains
-// just that page, we always treat them as abandoned and any thread
-// that frees the block can free the whole page and segment directly.
+// Large objects beyond the size classes get a page of their own, rounded to whole slices.
+// Huge pages contain just one block, and their segment contains just that page.
+// They are kept in the huge queue of the allocating heap like any other page:
+// a local free retires (and frees) the page directly, while a free from another
+// thread goes through the delayed free list of the owning heap.
 static mi_page_t* mi_large_huge_page_alloc(mi_heap_t* heap, size_t size) {
-  size_t block_size = _mi_os_good_alloc_size(size);
+  size_t block_size = (size <= MI_LARGE_OBJ_SIZE_MAX ? _mi_align_up(size, MI_SEGMENT_SLICE_SIZE) : _mi_os_good_alloc_size(size));
   mi_assert_internal(mi_bin(block_size) == MI_BIN_HUGE);
-  bool is_huge = (block_size > MI_LARGE_OBJ_SIZE_MAX);
-  mi_page_queue_t* pq = (is_huge ? NULL : mi_page_queue(heap, block_size));
+  mi_page_queue_t* pq = mi_page_queue(heap, block_size);
   mi_page_t* page = mi_page_fresh_alloc(heap, pq, block_size);
   if (page != NULL) {
     mi_assert_internal(mi_page_immediate_available(page));
-    
-    if (pq == NULL) {
-      // huge pages are directly abandoned
-      mi_assert_internal(_mi_page_segment(page)->kind == MI_SEGMENT_HUGE);
-      mi_assert_internal(_mi_page_segment(page)->used==1);
-      mi_assert_internal(_mi_page_segment(page)->thread_id==0); // abandoned, not in the huge queue
-      mi_page_set_heap(page, NULL);
-      _mi_page_add_detached_page(page);
-    }
-    else {
-      mi_assert_internal(_mi_page_segment(page)->kind != MI_SEGMENT_HUGE);
-    }
-    
+    mi_assert_internal(block_size <= MI_LARGE_OBJ_SIZE_MAX || _mi_page_segment(page)->kind == MI_SEGMENT_HUGE);
+    mi_assert_internal(_mi_page_segment(page)->kind != MI_SEGMENT_HUGE || _mi_page_segment(page)->used==1);
+
     const size_t bsize = mi_page_usable_block_size(page);  // note: not `mi_page_block_size` to account for padding
     if (bsize <= MI_LARGE_OBJ_SIZE_MAX) {
       mi_heap_stat_increase(heap, large, bsize);
@@ -856,7 +1043,7 @@ static mi_page_t* mi_large_huge_page_alloc(mi_heap_t* heap, size_t size) {
 static mi_page_t* mi_find_page(mi_heap_t* heap, size_t size) mi_attr_noexcept {
   // huge allocation?
   const size_t req_size = size - MI_PADDING_SIZE;  // correct for padding_size in case of an overflow on `size`  
-  if (mi_unlikely(req_size > (MI_MEDIUM_OBJ_SIZE_MAX - MI_PADDING_SIZE) )) {
+  if (mi_unlikely(req_size > (MI_LARGE_BIN_OBJ_SIZE_MAX - MI_PADDING_SIZE) )) {
     if (mi_unlikely(req_size > PTRDIFF_MAX)) {  // we don't allocate more than PTRDIFF_MAX (see <https://sourceware.org/ml/libc-announce/2019/msg00001.html>)
       _mi_error_message(EOVERFLOW, "allocation request is too large (%zu bytes)\n", req_size);
       return NULL;
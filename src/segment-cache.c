@@ -40,12 +40,208 @@ static mi_decl_cache_align mi_bitmap_field_t cache_available_large[MI_CACHE_FIEL
 static mi_decl_cache_align mi_bitmap_field_t cache_inuse[MI_CACHE_FIELDS];   // zero bit = free
 
 
+/* -----------------------------------------------------------
+  Huge segment cache
+  Huge segments (larger than MI_SEGMENT_SIZE) are not kept in the slot
+  cache, and a program that repeatedly allocates and frees huge blocks
+  would otherwise pay an mmap/munmap (and the page faults) per block.
+  We keep a few freed (fully committed) huge segments and reuse them by
+  best fit within the same power-of-two size bucket; a larger OS segment
+  is trimmed to size with `_mi_os_shrink`. The memory of a cached segment
+  is reset right away so an idle process does not keep it resident, and
+  entries are returned to the OS after `mi_option_segment_decommit_delay`
+  milli-seconds. The total size is bounded by `mi_option_huge_cache_max`.
+----------------------------------------------------------- */
+
+#define MI_HUGE_CACHE_MAX         (16)                    // maximal number of cached huge segments
+
+// maximal total size of the cached huge segments; segments larger than half of it are never cached
+static size_t mi_huge_cache_max_total(void) {
+  return (size_t)mi_option_get_clamp(mi_option_huge_cache_max, 0, 64*1024) * MI_MiB;
+}
+
+typedef struct mi_huge_cache_slot_s {
+  void*       p;           // NULL if the slot is empty
+  size_t      size;
+  size_t      memid;
+  bool        is_large;
+  bool        is_pinned;
+  mi_msecs_t  expire;
+} mi_huge_cache_slot_t;
+
+static mi_decl_cache_align _Atomic(bool) huge_cache_lock;        // = 0
+static mi_decl_cache_align _Atomic(size_t) huge_cache_count;     // = 0; racy check to avoid taking the lock
+static mi_huge_cache_slot_t huge_cache[MI_HUGE_CACHE_MAX];        // = 0; protected by `huge_cache_lock`
+static size_t huge_cache_total;                                   // = 0; protected by `huge_cache_lock`
+
+static void mi_huge_cache_lock(void) {
+  while (mi_atomic_exchange_acq_rel(&huge_cache_lock, true)) {
+    mi_atomic_yield();
+  }
+}
+
+static void mi_huge_cache_unlock(void) {
+  mi_atomic_store_release(&huge_cache_lock, false);
+}
+
+// Take a slot out of the cache (with the lock held)
+static void mi_huge_cache_take(mi_huge_cache_slot_t* slot, mi_huge_cache_slot_t* taken) {
+  mi_assert_internal(slot->p != NULL && huge_cache_total >= slot->size);
+  *taken = *slot;
+  huge_cache_total -= slot->size;
+  mi_atomic_decrement_relaxed(&huge_cache_count);
+  slot->p = NULL;
+}
+
+// Return a segment taken from the cache to the OS (or arena)
+static void mi_huge_cache_free(const mi_huge_cache_slot_t* slot, mi_os_tld_t* tld) {
+  if (!slot->is_pinned) _mi_stat_decrease(&_mi_stats_main.committed, slot->size);
+  _mi_stat_decrease(&_mi_stats_main.segments_cache, 1);
+  _mi_abandoned_await_readers();  // wait until safe to free
+  _mi_arena_free(slot->p, slot->size, slot->memid, slot->is_pinned /* pretend not committed to not double count decommits */, tld);
+}
+
+static mi_decl_noinline void mi_segment_cache_huge_purge(bool force, mi_os_tld_t* tld)
+{
+  if (mi_atomic_load_relaxed(&huge_cache_count) == 0) return;
+  const mi_msecs_t now = _mi_clock_now();
+  mi_huge_cache_slot_t expired[MI_HUGE_CACHE_MAX];
+  size_t count = 0;
+  mi_huge_cache_lock();
+  for (size_t i = 0; i < MI_HUGE_CACHE_MAX; i++) {
+    mi_huge_cache_slot_t* slot = &huge_cache[i];
+    if (slot->p != NULL && (force || now >= slot->expire)) {
+      mi_huge_cache_take(slot, &expired[count++]);
+    }
+  }
+  mi_huge_cache_unlock();
+  // free outside the lock
+  for (size_t i = 0; i < count; i++) {
+    mi_huge_cache_free(&expired[i], tld);
+  }
+}
+
+static mi_decl_noinline void* mi_segment_cache_huge_pop(size_t size, bool* large, bool* is_pinned, bool* is_zero, size_t* memid, mi_os_tld_t* tld)
+{
+  mi_assert_internal(size > MI_SEGMENT_SIZE);
+  if (mi_atomic_load_relaxed(&huge_cache_count) == 0) return NULL;
+
+  // find the best fit in the size bucket; only OS memory can be trimmed so arena memory must fit exactly
+  mi_huge_cache_slot_t found;
+  mi_huge_cache_slot_t* best = NULL;
+  mi_huge_cache_lock();
+  for (size_t i = 0; i < MI_HUGE_CACHE_MAX; i++) {
+    mi_huge_cache_slot_t* slot = &huge_cache[i];
+    if (slot->p == NULL || slot->size < size) continue;
+    if (slot->is_large && !*large) continue;
+    if (slot->size != size) {
+      if (slot->size/2 >= size) continue;  // not in the same size bucket
+      if (slot->is_large || slot->is_pinned || !_mi_arena_memid_is_os(slot->memid)) continue;
+    }
+    if (best == NULL || slot->size < best->size) {
+      best = slot;
+      if (slot->size == size) break;
+    }
+  }
+  if (best != NULL) mi_huge_cache_take(best, &found);
+  mi_huge_cache_unlock();
+  if (best == NULL) return NULL;
+
+  // trim the tail
+  if (found.size > size) {
+    if (!_mi_os_shrink(found.p, found.size, size, tld->stats)) {
+      mi_huge_cache_free(&found, tld);
+      return NULL;
+    }
+    found.size = size;
+  }
+  _mi_stat_decrease(&_mi_stats_main.segments_cache, 1);
+  *large = found.is_large;
+  *is_pinned = found.is_pinned;
+  *is_zero = false;
+  *memid = found.memid;
+  return found.p;
+}
+
+static mi_decl_noinline bool mi_segment_cache_huge_push(void* start, size_t size, size_t memid, const mi_commit_mask_t* commit_mask, bool is_large, bool is_pinned, mi_os_tld_t* tld)
+{
+  mi_assert_internal(size > MI_SEGMENT_SIZE);
+  const size_t max_total = mi_huge_cache_max_total();
+  if (size > max_total/2) return false;
+  if (!mi_commit_mask_is_full(commit_mask)) return false;  // only cache fully committed segments
+  const long delay = mi_option_get(mi_option_segment_decommit_delay);
+  if (delay <= 0) return false;
+
+  // release the physical memory but keep it committed for a fast reuse
+  if (!is_large && !is_pinned) {
+    _mi_os_reset(start, size, tld->stats);
+  }
+
+  // purge expired entries
+  mi_segment_cache_huge_purge(false /* force? */, tld);
+
+  // find an empty slot; evict the oldest entries if needed to stay within the bounds
+  mi_huge_cache_slot_t evicted[MI_HUGE_CACHE_MAX];
+  size_t count = 0;
+  mi_huge_cache_lock();
+  mi_huge_cache_slot_t* empty = NULL;
+  do {
+    mi_huge_cache_slot_t* oldest = NULL;
+    for (size_t i = 0; i < MI_HUGE_CACHE_MAX; i++) {
+      mi_huge_cache_slot_t* slot = &huge_cache[i];
+      if (slot->p == NULL) {
+        if (empty == NULL) empty = slot;
+      }
+      else if (oldest == NULL || slot->expire < oldest->expire) {
+        oldest = slot;
+      }
+    }
+    if (empty != NULL && huge_cache_total + size <= max_total) break;
+    mi_assert_internal(oldest != NULL);
+    mi_huge_cache_take(oldest, &evicted[count++]);
+    if (empty == NULL) empty = oldest;
+  } while (true);
+
+  // set the slot
+  empty->p = start;
+  empty->size = size;
+  empty->memid = memid;
+  empty->is_large = is_large;
+  empty->is_pinned = is_pinned;
+  empty->expire = _mi_clock_now() + delay;
+  huge_cache_total += size;
+  mi_atomic_increment_relaxed(&huge_cache_count);
+  mi_huge_cache_unlock();
+  _mi_stat_increase(&_mi_stats_main.segments_cache, 1);
+
+  // free evicted entries outside the lock
+  for (size_t i = 0; i < count; i++) {
+    mi_huge_cache_free(&evicted[i], tld);
+  }
+  return true;
+}
+
+
+/* -----------------------------------------------------------
+  Segment cache
+----------------------------------------------------------- */
+
 mi_decl_noinline void* _mi_segment_cache_pop(size_t size, mi_commit_mask_t* commit_mask, mi_commit_mask_t* decommit_mask, bool* large, bool* is_pinned, bool* is_zero, size_t* memid, mi_os_tld_t* tld)
 {
 #ifdef MI_CACHE_DISABLE
   return NULL;
 #else
 
+  // huge segments have their own cache
+  if (size > MI_SEGMENT_SIZE) {
+    void* p = mi_segment_cache_huge_pop(size, large, is_pinned, is_zero, memid, tld);
+    if (p != NULL) {
+      mi_commit_mask_create_full(commit_mask);
+      mi_commit_mask_create_empty(decommit_mask);
+    }
+    return p;
+  }
+
   // only segment blocks
   if (size != MI_SEGMENT_SIZE) return NULL;
 
@@ -153,6 +349,7 @@ static mi_decl_noinline void mi_segment_cache_purge(bool force, mi_os_tld_t* tld
 
 void _mi_segment_cache_collect(bool force, mi_os_tld_t* tld) {
   mi_segment_cache_purge(force, tld );
+  mi_segment_cache_huge_purge(force, tld);
 }
 
 mi_decl_noinline bool _mi_segment_cache_push(void* start, size_t size, size_t memid, const mi_commit_mask_t* commit_mask, const mi_commit_mask_t* decommit_mask, bool is_large, bool is_pinned, mi_os_tld_t* tld)
@@ -161,8 +358,15 @@ mi_decl_noinline bool _mi_segment_cache_push(void* start, size_t size, size_t me
   return false;
 #else
 
+  if (((uintptr_t)start % MI_SEGMENT_ALIGN) != 0) return false;
+
+  // huge segments have their own cache
+  if (size > MI_SEGMENT_SIZE) {
+    return mi_segment_cache_huge_push(start, size, memid, commit_mask, is_large, is_pinned, tld);
+  }
+
   // only for normal segment blocks
-  if (size != MI_SEGMENT_SIZE || ((uintptr_t)start % MI_SEGMENT_ALIGN) != 0) return false;
+  if (size != MI_SEGMENT_SIZE) return false;
 
   // numa node determines start field
   int numa_node = _mi_os_numa_node(NULL);
@@ -236,59 +440,120 @@ mi_decl_noinline bool _mi_segment_cache_push(void* start, size_t size, size_t me
 
 static _Atomic(uintptr_t) mi_segment_map[MI_SEGMENT_MAP_WSIZE + 1];  // 2KiB per TB with 64MiB segments
 
-static size_t mi_segment_map_index_of(const mi_segment_t* segment, size_t* bitidx) {
+// Segments in the reserved heap space (see `arena.c:_mi_arena_reserve_heap_space`) are tracked
+// in a separate map indexed by their offset in the space (as the space may be above `MI_MAX_ADDRESS`).
+// As long as all segments are in the heap space, pointers outside it are rejected by a range check.
+static _Atomic(uintptr_t)* mi_heap_space_map;   // `mi_heap_space_wsize + 1` words (or NULL)
+static uintptr_t           mi_heap_space_start;
+static uintptr_t           mi_heap_space_end;
+static size_t              mi_heap_space_wsize;
+static _Atomic(size_t)     mi_heap_space_only = 1; // `true` while no segment was allocated outside the heap space
+
+bool _mi_segment_map_init_space(void* start, size_t size) {
+  mi_assert_internal(mi_heap_space_map == NULL);
+  mi_assert_internal((uintptr_t)start % MI_SEGMENT_SIZE == 0);
+  const size_t wsize = _mi_divide_up(size / MI_SEGMENT_SIZE, MI_INTPTR_BITS);
+  _Atomic(uintptr_t)* map = (_Atomic(uintptr_t)*)_mi_os_alloc((wsize + 1) * sizeof(uintptr_t), &_mi_stats_main);  // zero initialized
+  if (map == NULL) return false;
+  mi_heap_space_start = (uintptr_t)start;
+  mi_heap_space_end   = (uintptr_t)start + size;
+  mi_heap_space_wsize = wsize;
+  mi_atomic_store_ptr_release(_Atomic(uintptr_t), &mi_heap_space_map, map);
+  return true;
+}
+
+static inline bool mi_is_in_heap_space(const void* p) {
+  return ((uintptr_t)p >= mi_heap_space_start && (uintptr_t)p < mi_heap_space_end);
+}
+
+// Return the map word index of a segment in `*map`; if the segment cannot be tracked
+// the index is `*wsize` (a word that is always zero).
+static size_t mi_segment_map_index_of(const mi_segment_t* segment, _Atomic(uintptr_t)** map, size_t* wsize, size_t* bitidx) {
   mi_assert_internal(_mi_ptr_segment(segment) == segment); // is it aligned on MI_SEGMENT_SIZE?
-  if ((uintptr_t)segment >= MI_MAX_ADDRESS) {
-    *bitidx = 0;
-    return MI_SEGMENT_MAP_WSIZE;
+  _Atomic(uintptr_t)* const space_map = mi_atomic_load_ptr_relaxed(_Atomic(uintptr_t), &mi_heap_space_map);
+  uintptr_t segindex;
+  if (space_map != NULL && mi_is_in_heap_space(segment)) {
+    *map = space_map;
+    *wsize = mi_heap_space_wsize;
+    segindex = ((uintptr_t)segment - mi_heap_space_start) / MI_SEGMENT_SIZE;
   }
   else {
-    const uintptr_t segindex = ((uintptr_t)segment) / MI_SEGMENT_SIZE;
-    *bitidx = segindex % MI_INTPTR_BITS;
-    const size_t mapindex = segindex / MI_INTPTR_BITS;
-    mi_assert_internal(mapindex < MI_SEGMENT_MAP_WSIZE);
-    return mapindex;
+    *map = mi_segment_map;
+    *wsize = MI_SEGMENT_MAP_WSIZE;
+    if ((uintptr_t)segment >= MI_MAX_ADDRESS) {
+      *bitidx = 0;
+      return MI_SEGMENT_MAP_WSIZE;
+    }
+    segindex = ((uintptr_t)segment) / MI_SEGMENT_SIZE;
   }
+  *bitidx = segindex % MI_INTPTR_BITS;
+  const size_t mapindex = segindex / MI_INTPTR_BITS;
+  mi_assert_internal(mapindex < *wsize);
+  return mapindex;
 }
 
 void _mi_segment_map_allocated_at(const mi_segment_t* segment) {
   size_t bitidx;
-  size_t index = mi_segment_map_index_of(segment, &bitidx);
-  mi_assert_internal(index <= MI_SEGMENT_MAP_WSIZE);
-  if (index==MI_SEGMENT_MAP_WSIZE) return;
-  uintptr_t mask = mi_atomic_load_relaxed(&mi_segment_map[index]);
+  size_t wsize;
+  _Atomic(uintptr_t)* map;
+  size_t index = mi_segment_map_index_of(segment, &map, &wsize, &bitidx);
+  if (map == mi_segment_map && mi_atomic_load_relaxed(&mi_heap_space_only) != 0) {
+    mi_atomic_store_release(&mi_heap_space_only, (size_t)0);  // no longer reject pointers outside the heap space
+  }
+  mi_assert_internal(index <= wsize);
+  if (index==wsize) return;
+  uintptr_t mask = mi_atomic_load_relaxed(&map[index]);
   uintptr_t newmask;
   do {
     newmask = (mask | ((uintptr_t)1 << bitidx));
-  } while (!mi_atomic_cas_weak_release(&mi_segment_map[index], &mask, newmask));
+  } while (!mi_atomic_cas_weak_release(&map[index], &mask, newmask));
 }
 
 void _mi_segment_map_freed_at(const mi_segment_t* segment) {
   size_t bitidx;
-  size_t index = mi_segment_map_index_of(segment, &bitidx);
-  mi_assert_internal(index <= MI_SEGMENT_MAP_WSIZE);
-  if (index == MI_SEGMENT_MAP_WSIZE) return;
-  uintptr_t mask = mi_atomic_load_relaxed(&mi_segment_map[index]);
+  size_t wsize;
+  _Atomic(uintptr_t)* map;
+  size_t index = mi_segment_map_index_of(segment, &map, &wsize, &bitidx);
+  mi_assert_internal(index <= wsize);
+  if (index == wsize) return;
+  uintptr_t mask = mi_atomic_load_relaxed(&map[index]);
   uintptr_t newmask;
   do {
     newmask = (mask & ~((uintptr_t)1 << bitidx));
-  } while (!mi_atomic_cas_weak_release(&mi_segment_map[index], &mask, newmask));
+  } while (!mi_atomic_cas_weak_release(&map[index], &mask, newmask));
+}
+
+// Forget all segments in a forked child (see `_mi_fork_child`).
+void _mi_segment_map_fork_child(void) {
+  for (size_t i = 0; i <= MI_SEGMENT_MAP_WSIZE; i++) {
+    mi_atomic_store_relaxed(&mi_segment_map[i], 0);
+  }
+  _Atomic(uintptr_t)* const space_map = mi_atomic_load_ptr_relaxed(_Atomic(uintptr_t), &mi_heap_space_map);
+  if (space_map != NULL) {
+    for (size_t i = 0; i <= mi_heap_space_wsize; i++) {
+      mi_atomic_store_relaxed(&space_map[i], 0);
+    }
+  }
 }
 
 // Determine the segment belonging to a pointer or NULL if it is not in a valid segment.
-static mi_segment_t* _mi_segment_of(const void* p) {
+mi_segment_t* _mi_segment_of(const void* p) {
   mi_segment_t* segment = _mi_ptr_segment(p);
   if (segment == NULL) return NULL; 
   size_t bitidx;
-  size_t index = mi_segment_map_index_of(segment, &bitidx);
+  size_t wsize;
+  _Atomic(uintptr_t)* map;
+  size_t index = mi_segment_map_index_of(segment, &map, &wsize, &bitidx);
   // fast path: for any pointer to valid small/medium/large object or first MI_SEGMENT_SIZE in huge
-  const uintptr_t mask = mi_atomic_load_relaxed(&mi_segment_map[index]);
+  const uintptr_t mask = mi_atomic_load_relaxed(&map[index]);
   if (mi_likely((mask & ((uintptr_t)1 << bitidx)) != 0)) {
     return segment; // yes, allocated by us
   }
-  if (index==MI_SEGMENT_MAP_WSIZE) return NULL;
-
-  // TODO: maintain max/min allocated range for efficiency for more efficient rejection of invalid pointers?
+  if (index==wsize) return NULL;
+  if (map == mi_segment_map && mi_atomic_load_acquire(&mi_heap_space_only) != 0 && 
+      mi_atomic_load_ptr_relaxed(_Atomic(uintptr_t), &mi_heap_space_map) != NULL) {
+    return NULL;  // all our segments are in the heap space
+  }
 
   // search downwards for the first segment in case it is an interior pointer
   // could be slow but searches in MI_INTPTR_SIZE * MI_SEGMENT_SIZE (512MiB) steps trough
@@ -310,12 +575,12 @@ static mi_segment_t* _mi_segment_of(const void* p) {
     loindex = index;
     do {
       loindex--;  
-      lomask = mi_atomic_load_relaxed(&mi_segment_map[loindex]);      
+      lomask = mi_atomic_load_relaxed(&map[loindex]);      
     } while (lomask != 0 && loindex > 0);
     if (lomask == 0) return NULL;
     lobitidx = mi_bsr(lomask);    // lomask != 0
   }
-  mi_assert_internal(loindex < MI_SEGMENT_MAP_WSIZE);
+  mi_assert_internal(loindex < wsize);
   // take difference as the addresses could be larger than the MAX_ADDRESS space.
   size_t diff = (((index - loindex) * (8*MI_INTPTR_SIZE)) + bitidx - lobitidx) * MI_SEGMENT_SIZE;
   segment = (mi_segment_t*)((uint8_t*)segment - diff);
@@ -9,6 +9,7 @@ terms of the MIT license. A copy of the license can be found in the file
 #include "mimalloc-atomic.h"
 
 #include <string.h>  // memset
+#include <errno.h>   // ENOMEM
 
 #define MI_PAGE_HUGE_ALIGN  (256*1024)
 
@@ -267,9 +268,9 @@ static bool mi_segment_is_valid(mi_segment_t* segment, mi_segments_tld_t* tld) {
     mi_assert_internal(slice->slice_offset == 0);
     size_t index = mi_slice_index(slice);
     size_t maxindex = (index + slice->slice_count >= segment->slice_entries ? segment->slice_entries : index + slice->slice_count) - 1;
-    if (mi_slice_is_used(slice)) { // a page in use, we need at least MAX_SLICE_OFFSET valid back offsets
+    if (mi_slice_is_used(slice)) { // a page in use, we need valid back offsets (at least MAX_SLICE_OFFSET in a huge segment)
       used_count++;
-      for (size_t i = 0; i <= MI_MAX_SLICE_OFFSET && index + i <= maxindex; i++) {
+      for (size_t i = 0; (i <= MI_MAX_SLICE_OFFSET || segment->kind != MI_SEGMENT_HUGE) && index + i <= maxindex; i++) {
         mi_assert_internal(segment->slices[index + i].slice_offset == i*sizeof(mi_slice_t));
         mi_assert_internal(i==0 || segment->slices[index + i].slice_count == 0);
         mi_assert_internal(i==0 || segment->slices[index + i].xblock_size == 1);
@@ -358,19 +359,155 @@ We keep a small segment cache per thread to increase local
 reuse and avoid setting/clearing guard pages in secure mode.
 ------------------------------------------------------------------------------- */
 
-static void mi_segments_track_size(long segment_size, mi_segments_tld_t* tld) {
+// Huge segments are not counted per thread as they can be freed by any thread (see `_mi_segment_huge_page_free`)
+static void mi_segments_track_size(long segment_size, bool is_huge, mi_segments_tld_t* tld) {
   if (segment_size>=0) _mi_stat_increase(&tld->stats->segments,1);
                   else _mi_stat_decrease(&tld->stats->segments,1);
+  if (is_huge) return;
   tld->count += (segment_size >= 0 ? 1 : -1);
   if (tld->count > tld->peak_count) tld->peak_count = tld->count;
   tld->current_size += segment_size;
   if (tld->current_size > tld->peak_size) tld->peak_size = tld->current_size;
 }
 
+static _Atomic(uintptr_t)* mi_segment_bits(mi_segment_t* segment, _Atomic(uintptr_t*)* table, bool create);
+static void mi_segment_bits_free(_Atomic(uintptr_t*)* table);
+static void mi_segment_bits_clear(_Atomic(uintptr_t)* bits, const mi_segment_t* segment, const void* start, size_t size);
+
+/* -----------------------------------------------------------
+  Fork exclusion
+  Segments that are not excluded from a fork (as they were allocated
+  before `mi_option_exclude_from_fork` was set, or the exclusion failed
+  or was skipped) are kept in a list so a forked child can abandon them
+  instead of forgetting them (see `_mi_fork_child`).
+----------------------------------------------------------- */
+
+static mi_segment_t* segments_visible;                             // = NULL; protected by the lock
+static _Atomic(size_t) segments_excluded;                          // = 0; live segments excluded from a fork
+static mi_decl_cache_align _Atomic(bool) segments_visible_lock;    // = false
+
+static void mi_segments_visible_lock(void) {
+  while (mi_atomic_exchange_acq_rel(&segments_visible_lock, true)) {
+    mi_atomic_yield();
+  }
+}
+
+static void mi_segments_visible_unlock(void) {
+  mi_atomic_store_release(&segments_visible_lock, false);
+}
+
+static void mi_segment_fork_track(mi_segment_t* segment) {
+  if (segment->fork_mode > 0) {
+    mi_atomic_increment_relaxed(&segments_excluded);
+    return;
+  }
+  mi_segments_visible_lock();
+  segment->fork_prev = NULL;
+  segment->fork_next = segments_visible;
+  if (segments_visible != NULL) segments_visible->fork_prev = segment;
+  segments_visible = segment;
+  mi_segments_visible_unlock();
+}
+
+static void mi_segment_fork_untrack(mi_segment_t* segment) {
+  if (segment->fork_mode > 0) {
+    mi_atomic_decrement_relaxed(&segments_excluded);
+    return;
+  }
+  mi_segments_visible_lock();
+  if (segment->fork_prev != NULL || segments_visible == segment) {  // not yet tracked if the initialization failed
+    if (segment->fork_prev != NULL) segment->fork_prev->fork_next = segment->fork_next;
+    if (segment->fork_next != NULL) segment->fork_next->fork_prev = segment->fork_prev;
+    if (segment == segments_visible) segments_visible = segment->fork_next;
+    segment->fork_next = NULL;
+    segment->fork_prev = NULL;
+  }
+  mi_segments_visible_unlock();
+}
+
+// Are there live segments that are excluded from a fork? If not, a forked child has nothing to reset.
+bool _mi_segments_fork_excluded(void) {
+  return (mi_atomic_load_relaxed(&segments_excluded) > 0);
+}
+
+// Is `p` in a segment that is still present in a forked child? (called in the child)
+bool _mi_segment_fork_visible(const void* p) {
+  const mi_segment_t* const segment = _mi_ptr_segment(p);
+  for (const mi_segment_t* s = segments_visible; s != NULL; s = s->fork_next) {
+    if (s == segment) return true;
+  }
+  return false;
+}
+
+static void mi_abandoned_push(mi_segment_t* segment);
+static void mi_segment_summary_clear(mi_segment_t* segment);
+static void mi_segment_summary_add_span(mi_segment_t* segment, size_t slice_count);
+static void mi_segment_summary_add_page(mi_segment_t* segment, const mi_page_t* page);
+
+// Abandon a segment in a forked child as in `mi_segment_abandon`; the heaps and
+// span queues that referred to its pages are already reset.
+static void mi_segment_fork_abandon(mi_segment_t* segment) {
+  if (segment->thread_id != 0) {
+    mi_segment_summary_clear(segment);
+    mi_slice_t* slice = &segment->slices[0];
+    const mi_slice_t* end = mi_segment_slices_end(segment);
+    while (slice < end) {
+      mi_assert_internal(slice->slice_count > 0);
+      mi_page_t* const page = mi_slice_to_page(slice);
+      if (slice->xblock_size == 0) {  // a free span
+        page->next = NULL;
+        page->prev = NULL;
+        mi_segment_summary_add_span(segment, slice->slice_count);
+      }
+      else if (slice != &segment->slices[0]) {  // skip the segment info
+        // note: we cannot wait for `MI_DELAYED_FREEING` as the freeing thread is gone
+        mi_atomic_store_release(&page->xheap, (uintptr_t)NULL);
+        const mi_thread_free_t tfree = mi_atomic_load_relaxed(&page->xthread_free);
+        mi_atomic_store_release(&page->xthread_free, mi_tf_set_delayed(tfree, MI_NEVER_DELAYED_FREE));
+        page->next = NULL;
+        page->prev = NULL;
+        page->delayed_next = NULL;
+        page->retire_expire = 0;
+        mi_page_set_in_full(page, false);
+        mi_segment_summary_add_page(segment, page);
+        _mi_stat_increase(&_mi_stats_main.pages_abandoned, 1);
+      }
+      slice = slice + slice->slice_count;
+    }
+    segment->abandoned = segment->used;
+    segment->thread_id = 0;
+    segment->abandoned_visits = 1;
+    _mi_stat_increase(&_mi_stats_main.segments_abandoned, 1);
+  }
+  mi_atomic_store_ptr_release(mi_segment_t, &segment->abandoned_next, NULL);
+  mi_abandoned_push(segment);
+}
+
+// Called in a forked child after the heaps, the abandoned list, and the segment map
+// are reset: the excluded segments are gone and the others are abandoned (see `_mi_fork_child`).
+void _mi_segments_fork_child_abandon(void) {
+  mi_atomic_store_release(&segments_visible_lock, false);  // may have been held by another thread of the parent
+  mi_atomic_store_relaxed(&segments_excluded, (size_t)0);
+  for (mi_segment_t* segment = segments_visible; segment != NULL; segment = segment->fork_next) {
+    mi_assert_internal(segment->used > 0);
+    _mi_segment_map_allocated_at(segment);
+    mi_segment_fork_abandon(segment);
+  }
+}
+
 static void mi_segment_os_free(mi_segment_t* segment, mi_segments_tld_t* tld) {
   segment->thread_id = 0;
   _mi_segment_map_freed_at(segment);
-  mi_segments_track_size(-((long)mi_segment_size(segment)),tld);
+  mi_segment_bits_free(&segment->marks);
+  #if MI_LIVE_BITS
+  mi_segment_bits_free(&segment->live);
+  #endif
+  mi_segment_fork_untrack(segment);
+  if (segment->fork_mode > 0) {
+    // include again before the memory is reused from the cache or arena
+    _mi_os_exclude_from_fork(segment, mi_segment_size(segment), segment->fork_mode, false);
+  }
+  mi_segments_track_size(-((long)mi_segment_size(segment)), segment->kind == MI_SEGMENT_HUGE, tld);
   if (MI_SECURE>0) {
     // _mi_os_unprotect(segment, mi_segment_size(segment)); // ensure no more guard pages are set
     // unprotect the guard pages; we cannot just unprotect the whole segment size as part may be decommitted
@@ -385,7 +522,7 @@ static void mi_segment_os_free(mi_segment_t* segment, mi_segments_tld_t* tld) {
   
   // _mi_os_free(segment, mi_segment_size(segment), /*segment->memid,*/ tld->stats);
   const size_t size = mi_segment_size(segment);
-  if (size != MI_SEGMENT_SIZE || !_mi_segment_cache_push(segment, size, segment->memid, &segment->commit_mask, &segment->decommit_mask, segment->mem_is_large, segment->mem_is_pinned, tld->os)) {
+  if (!_mi_segment_cache_push(segment, size, segment->memid, &segment->commit_mask, &segment->decommit_mask, segment->mem_is_large, segment->mem_is_pinned, tld->os)) {
     const size_t csize = _mi_commit_mask_committed_size(&segment->commit_mask, size);
     if (csize > 0 && !segment->mem_is_pinned) _mi_stat_decrease(&_mi_stats_main.committed, csize);
     _mi_abandoned_await_readers();  // wait until safe to free
@@ -393,6 +530,17 @@ static void mi_segment_os_free(mi_segment_t* segment, mi_segments_tld_t* tld) {
   }
 }
 
+// called in a forked child when segments were excluded from the fork (see `_mi_fork_child`);
+// the segments of the thread are either gone or abandoned
+void _mi_segments_fork_child(mi_segments_tld_t* tld) {
+  for (size_t i = 0; i <= MI_SEGMENT_BIN_MAX; i++) {
+    tld->spans[i].first = NULL;
+    tld->spans[i].last = NULL;
+  }
+  tld->count = 0;
+  tld->current_size = 0;
+}
+
 // called by threads that are terminating 
 void _mi_segment_thread_collect(mi_segments_tld_t* tld) {
   MI_UNUSED(tld);
@@ -626,7 +774,8 @@ static mi_slice_t* mi_segment_span_free_coalesce(mi_slice_t* slice, mi_segments_
 
   // for huge pages, just mark as free but don't add to the queues
   if (segment->kind == MI_SEGMENT_HUGE) {
-    mi_assert_internal(segment->used == 1);  // decreased right after this call in `mi_segment_page_clear`
+    // `used` can be 0 if the huge block was freed while the segment was abandoned (and reclaim gets here)
+    mi_assert_internal((segment->used == 0 && slice->xblock_size == 0) || segment->used == 1);  // decreased right after this call in `mi_segment_page_clear`
     slice->xblock_size = 0;  // mark as free anyways
     // we should mark the last slice `xblock_size=0` now to maintain invariants but we skip it to 
     // avoid a possible cache miss (and the segment is about to be freed)
@@ -693,9 +842,10 @@ static mi_page_t* mi_segment_span_allocate(mi_segment_t* segment, size_t slice_i
   mi_page_t*  page = mi_slice_to_page(slice);
   mi_assert_internal(mi_page_block_size(page) == bsize);
 
-  // set slice back pointers for the first MI_MAX_SLICE_OFFSET entries
+  // set slice back pointers for all entries as large pages can contain multiple blocks;
+  // huge pages contain a single block and only need the first MI_MAX_SLICE_OFFSET entries (for aligned pointers)
   size_t extra = slice_count-1;
-  if (extra > MI_MAX_SLICE_OFFSET) extra = MI_MAX_SLICE_OFFSET;
+  if (segment->kind == MI_SEGMENT_HUGE && extra > MI_MAX_SLICE_OFFSET) extra = MI_MAX_SLICE_OFFSET;
   if (slice_index + extra >= segment->slice_entries) extra = segment->slice_entries - slice_index - 1;  // huge objects may have more slices than avaiable entries in the segment->slices
   slice++;
   for (size_t i = 1; i <= extra; i++, slice++) {
@@ -820,7 +970,7 @@ static mi_segment_t* mi_segment_init(mi_segment_t* segment, size_t required, mi_
     segment->mem_is_pinned = is_pinned;
     segment->mem_is_large = mem_large;
     segment->mem_is_committed = mi_commit_mask_is_full(&commit_mask);
-    mi_segments_track_size((long)(segment_size), tld);
+    mi_segments_track_size((long)(segment_size), required > 0, tld);
     _mi_segment_map_allocated_at(segment);
   }
 
@@ -863,6 +1013,21 @@ static mi_segment_t* mi_segment_init(mi_segment_t* segment, size_t required, mi_
   segment->slice_entries = slice_entries;
   segment->kind = (required == 0 ? MI_SEGMENT_NORMAL : MI_SEGMENT_HUGE);
 
+  #if MI_LIVE_BITS
+  // allocate the live bits upfront so allocation and free never need to check
+  if (mi_segment_bits(segment, &segment->live, true) == NULL) {
+    mi_segment_os_free(segment, tld);
+    return NULL;
+  }
+  #endif
+
+  // don't copy the segment into a forked child process
+  const long fork_mode = mi_option_get(mi_option_exclude_from_fork);
+  if (fork_mode > 0 && _mi_os_exclude_from_fork(segment, mi_segment_size(segment), (int)fork_mode, true)) {
+    segment->fork_mode = (int)fork_mode;
+  }
+  mi_segment_fork_track(segment);
+
   // memset(segment->slices, 0, sizeof(mi_slice_t)*(info_slices+1));
   _mi_stat_increase(&tld->stats->page_committed, mi_segment_info_size(segment));
 
@@ -966,6 +1131,16 @@ static mi_slice_t* mi_segment_page_clear(mi_page_t* page, mi_segments_tld_t* tld
     _mi_os_reset(start, psize, tld->stats);
   }
 
+  // clear stale mark (and live) bits so a next page in this span starts out clean
+  if (mi_atomic_load_ptr_relaxed(uintptr_t, &segment->marks) != NULL || MI_LIVE_BITS) {
+    size_t psize;
+    uint8_t* start = _mi_page_start(segment, page, &psize);
+    _mi_segment_marks_clear(segment, start, psize);
+    #if MI_LIVE_BITS
+    mi_segment_bits_clear(mi_segment_bits(segment, &segment->live, false), segment, start, psize);
+    #endif
+  }
+
   // zero the page data, but not the segment fields
   page->is_zero_init = false;
   ptrdiff_t ofs = offsetof(mi_page_t, capacity);
@@ -1060,6 +1235,76 @@ static mi_decl_cache_align _Atomic(size_t)           abandoned_visited_count;
 // still be read.
 static mi_decl_cache_align _Atomic(size_t)           abandoned_readers; // = 0
 
+// Abandoned huge segments are kept in a separate list protected by a lock: a huge
+// segment has a single block so there is nothing to reclaim, and a free from any
+// thread unlinks and frees it right away (see `_mi_segment_huge_page_free`).
+static mi_decl_cache_align _Atomic(mi_segment_t*)       abandoned_huge;      // = NULL
+static mi_decl_cache_align _Atomic(bool)                abandoned_huge_lock; // = false
+
+static void mi_abandoned_huge_lock_acquire(void) {
+  while (mi_atomic_exchange_acq_rel(&abandoned_huge_lock, true)) {
+    mi_atomic_yield();
+  }
+}
+
+static void mi_abandoned_huge_lock_release(void) {
+  mi_atomic_store_release(&abandoned_huge_lock, false);
+}
+
+static void mi_abandoned_huge_push(mi_segment_t* segment) {
+  mi_assert_internal(segment->kind == MI_SEGMENT_HUGE);
+  mi_abandoned_huge_lock_acquire();
+  mi_atomic_store_ptr_relaxed(mi_segment_t, &segment->abandoned_next, mi_atomic_load_ptr_relaxed(mi_segment_t, &abandoned_huge));
+  mi_atomic_store_ptr_release(mi_segment_t, &abandoned_huge, segment);
+  mi_abandoned_huge_lock_release();
+}
+
+// Unlink an abandoned huge segment and claim it for `thread_id`; returns `false` if
+// it is not (or not yet) in the list. Must be called with the lock held.
+static bool mi_abandoned_huge_claim_locked(mi_segment_t* segment, mi_threadid_t thread_id) {
+  _Atomic(mi_segment_t*)* prev = &abandoned_huge;
+  mi_segment_t* s;
+  while ((s = mi_atomic_load_ptr_relaxed(mi_segment_t, prev)) != NULL && s != segment) {
+    prev = &s->abandoned_next;
+  }
+  if (s == NULL) return false;
+  mi_threadid_t expected = 0;
+  if (!mi_atomic_cas_strong_acq_rel(&segment->thread_id, &expected, thread_id)) return false;
+  mi_atomic_store_ptr_relaxed(mi_segment_t, prev, mi_atomic_load_ptr_relaxed(mi_segment_t, &segment->abandoned_next));
+  mi_atomic_store_ptr_release(mi_segment_t, &segment->abandoned_next, NULL);
+  return true;
+}
+
+static bool mi_abandoned_huge_claim(mi_segment_t* segment, mi_threadid_t thread_id) {
+  mi_abandoned_huge_lock_acquire();
+  const bool claimed = mi_abandoned_huge_claim_locked(segment, thread_id);
+  mi_abandoned_huge_lock_release();
+  return claimed;
+}
+
+static mi_segment_t* mi_abandoned_huge_pop(void) {
+  if (mi_atomic_load_ptr_relaxed(mi_segment_t, &abandoned_huge) == NULL) return NULL;
+  mi_abandoned_huge_lock_acquire();
+  mi_segment_t* segment = mi_atomic_load_ptr_relaxed(mi_segment_t, &abandoned_huge);
+  if (segment != NULL) {
+    mi_atomic_store_ptr_relaxed(mi_segment_t, &abandoned_huge, mi_atomic_load_ptr_relaxed(mi_segment_t, &segment->abandoned_next));
+    mi_atomic_store_ptr_release(mi_segment_t, &segment->abandoned_next, NULL);
+  }
+  mi_abandoned_huge_lock_release();
+  return segment;
+}
+
+// Forget all abandoned segments in a forked child (see `_mi_fork_child`)
+void _mi_abandoned_fork_child(void) {
+  mi_atomic_store_ptr_relaxed(mi_segment_t, &abandoned_huge, NULL);
+  mi_atomic_store_release(&abandoned_huge_lock, false);
+  mi_atomic_store_ptr_relaxed(mi_segment_t, &abandoned_visited, NULL);
+  mi_atomic_store_relaxed(&abandoned, (mi_tagged_segment_t)0);
+  mi_atomic_store_relaxed(&abandoned_count, 0);
+  mi_atomic_store_relaxed(&abandoned_visited_count, 0);
+  mi_atomic_store_relaxed(&abandoned_readers, 0);
+}
+
 // Push on the visited list
 static void mi_abandoned_visited_push(mi_segment_t* segment) {
   mi_assert_internal(segment->thread_id == 0);
@@ -1123,6 +1368,10 @@ static void mi_abandoned_push(mi_segment_t* segment) {
   mi_assert_internal(mi_atomic_load_ptr_relaxed(mi_segment_t, &segment->abandoned_next) == NULL);
   mi_assert_internal(segment->next == NULL);
   mi_assert_internal(segment->used > 0);
+  if (segment->kind == MI_SEGMENT_HUGE) {
+    mi_abandoned_huge_push(segment);
+    return;
+  }
   mi_tagged_segment_t next;
   mi_tagged_segment_t ts = mi_atomic_load_relaxed(&abandoned);
   do {
@@ -1180,6 +1429,60 @@ static mi_segment_t* mi_abandoned_pop(void) {
    Abandon segment/page
 ----------------------------------------------------------- */
 
+/* -----------------------------------------------------------
+  Abandoned segment summary: a compact (and racy) hint of the
+  bins that have pages with free blocks and of the largest free
+  span. It is computed when a segment is abandoned or fully
+  visited, and updated on concurrent frees, so reclaimers can
+  skip segments that cannot satisfy the allocation without
+  visiting all their slices. A missed update only delays the
+  reclaim as segments are always reclaimed after a few visits.
+----------------------------------------------------------- */
+
+static void mi_segment_summary_clear(mi_segment_t* segment) {
+  for (size_t i = 0; i < MI_BIN_MAP_SIZE; i++) {
+    mi_atomic_store_relaxed(&segment->abandoned_bins[i], (uintptr_t)0);
+  }
+  mi_atomic_store_relaxed(&segment->abandoned_span, (size_t)0);
+}
+
+static void mi_segment_summary_add_bin(mi_segment_t* segment, size_t bin) {
+  mi_assert_internal(bin <= MI_BIN_HUGE);
+  _Atomic(uintptr_t)* const word = &segment->abandoned_bins[bin / MI_INTPTR_BITS];
+  const uintptr_t mask = ((uintptr_t)1 << (bin % MI_INTPTR_BITS));
+  if ((mi_atomic_load_relaxed(word) & mask) == 0) {  // avoid writing a shared cache line if already set
+    mi_atomic_or_acq_rel(word, mask);
+  }
+}
+
+static void mi_segment_summary_add_span(mi_segment_t* segment, size_t slice_count) {
+  size_t span = mi_atomic_load_relaxed(&segment->abandoned_span);
+  while (span < slice_count && !mi_atomic_cas_weak_release(&segment->abandoned_span, &span, slice_count)) { /* nothing */ };
+}
+
+static void mi_segment_summary_add_page(mi_segment_t* segment, const mi_page_t* page) {
+  if (mi_page_has_any_available(page)) {
+    mi_segment_summary_add_bin(segment, _mi_bin(page->xblock_size));
+  }
+}
+
+// Called on a concurrent free of a block in a page of an abandoned segment. This must be
+// called before the block is pushed on the thread free list as the segment may be freed right after.
+void _mi_segment_abandoned_page_free(mi_segment_t* segment, const mi_page_t* page) {
+  mi_segment_summary_add_bin(segment, _mi_bin(page->xblock_size));
+  mi_segment_summary_add_span(segment, page->slice_count);   // the page may become all free
+}
+
+// Can this abandoned segment have a free span of at least `slices_needed` or
+// a page with free blocks of `block_size`? (false positives are possible)
+static bool mi_segment_abandoned_may_fit(mi_segment_t* segment, size_t slices_needed, size_t block_size) {
+  if (mi_atomic_load_relaxed(&segment->abandoned_span) >= slices_needed) return true;
+  if (block_size == 0) return false;
+  const size_t bin = _mi_bin(block_size);
+  const uintptr_t mask = ((uintptr_t)1 << (bin % MI_INTPTR_BITS));
+  return ((mi_atomic_load_relaxed(&segment->abandoned_bins[bin / MI_INTPTR_BITS]) & mask) != 0);
+}
+
 static void mi_segment_abandon(mi_segment_t* segment, mi_segments_tld_t* tld) {
   mi_assert_internal(segment->used == segment->abandoned);
   mi_assert_internal(segment->used > 0);
@@ -1187,7 +1490,8 @@ static void mi_segment_abandon(mi_segment_t* segment, mi_segments_tld_t* tld) {
   mi_assert_internal(segment->abandoned_visits == 0);
   mi_assert_expensive(mi_segment_is_valid(segment,tld));
   
-  // remove the free pages from the free page queues
+  // remove the free pages from the free page queues and summarize the free space
+  mi_segment_summary_clear(segment);
   mi_slice_t* slice = &segment->slices[0];
   const mi_slice_t* end = mi_segment_slices_end(segment);
   while (slice < end) {
@@ -1196,6 +1500,10 @@ static void mi_segment_abandon(mi_segment_t* segment, mi_segments_tld_t* tld) {
     if (slice->xblock_size == 0) { // a free page
       mi_segment_span_remove_from_queue(slice,tld);
       slice->xblock_size = 0; // but keep it free
+      mi_segment_summary_add_span(segment, slice->slice_count);
+    }
+    else if (slice != &segment->slices[0]) {  // skip the segment info
+      mi_segment_summary_add_page(segment, mi_slice_to_page(slice));
     }
     slice = slice + slice->slice_count;
   }
@@ -1205,7 +1513,7 @@ static void mi_segment_abandon(mi_segment_t* segment, mi_segments_tld_t* tld) {
   
   // all pages in the segment are abandoned; add it to the abandoned list
   _mi_stat_increase(&tld->stats->segments_abandoned, 1);
-  mi_segments_track_size(-((long)mi_segment_size(segment)), tld);
+  mi_segments_track_size(-((long)mi_segment_size(segment)), segment->kind == MI_SEGMENT_HUGE, tld);
   segment->thread_id = 0;
   mi_atomic_store_ptr_release(mi_segment_t, &segment->abandoned_next, NULL);
   segment->abandoned_visits = 1;   // from 0 to 1 to signify it is abandoned
@@ -1247,6 +1555,7 @@ static bool mi_segment_check_free(mi_segment_t* segment, size_t slices_needed, s
   mi_assert_internal(block_size < MI_HUGE_BLOCK_SIZE);
   mi_assert_internal(mi_segment_is_abandoned(segment));
   bool has_page = false;
+  mi_segment_summary_clear(segment);  // and recompute it while visiting
   
   // for all slices
   const mi_slice_t* end;
@@ -1265,11 +1574,13 @@ static bool mi_segment_check_free(mi_segment_t* segment, size_t slices_needed, s
         segment->abandoned--;
         slice = mi_segment_page_clear(page, tld); // re-assign slice due to coalesce!
         mi_assert_internal(!mi_slice_is_used(slice));
+        mi_segment_summary_add_span(segment, slice->slice_count);
         if (slice->slice_count >= slices_needed) {
           has_page = true;
         }
       }
       else {
+        mi_segment_summary_add_page(segment, page);
         if (page->xblock_size == block_size && mi_page_has_any_available(page)) {
           // a page has available free blocks of the right size
           has_page = true;
@@ -1278,6 +1589,7 @@ static bool mi_segment_check_free(mi_segment_t* segment, size_t slices_needed, s
     }
     else {
       // empty span
+      mi_segment_summary_add_span(segment, slice->slice_count);
       if (slice->slice_count >= slices_needed) {
         has_page = true;
       }
@@ -1289,6 +1601,8 @@ static bool mi_segment_check_free(mi_segment_t* segment, size_t slices_needed, s
 
 // Reclaim an abandoned segment; returns NULL if the segment was freed
 // set `right_page_reclaimed` to `true` if it reclaimed a page of the right `block_size` that was not full.
+// note: all pages are reclaimed into the heap; a segment is owned by a single thread and pages that
+// were left abandoned in an owned segment would be in no heap and not on the abandoned list either.
 static mi_segment_t* mi_segment_reclaim(mi_segment_t* segment, mi_heap_t* heap, size_t requested_block_size, bool* right_page_reclaimed, mi_segments_tld_t* tld) {
   mi_assert_internal(mi_atomic_load_ptr_relaxed(mi_segment_t, &segment->abandoned_next) == NULL);
   mi_assert_expensive(mi_segment_is_valid(segment, tld));
@@ -1296,7 +1610,7 @@ static mi_segment_t* mi_segment_reclaim(mi_segment_t* segment, mi_heap_t* heap,
 
   segment->thread_id = _mi_thread_id();
   segment->abandoned_visits = 0;
-  mi_segments_track_size((long)mi_segment_size(segment), tld);
+  mi_segments_track_size((long)mi_segment_size(segment), segment->kind == MI_SEGMENT_HUGE, tld);
   mi_assert_internal(segment->next == NULL);
   _mi_stat_decrease(&tld->stats->segments_abandoned, 1);
   
@@ -1357,6 +1671,35 @@ void _mi_abandoned_reclaim_all(mi_heap_t* heap, mi_segments_tld_t* tld) {
   while ((segment = mi_abandoned_pop()) != NULL) {
     mi_segment_reclaim(segment, heap, 0, NULL, tld);
   }
+  while ((segment = mi_abandoned_huge_pop()) != NULL) {
+    mi_segment_reclaim(segment, heap, 0, NULL, tld);
+  }
+}
+
+// Free the abandoned huge segments whose block was freed by a thread that could not
+// free the segment itself (see `_mi_segment_huge_page_free`).
+static void mi_abandoned_huge_collect(mi_heap_t* heap, mi_segments_tld_t* tld) {
+  if (mi_atomic_load_ptr_relaxed(mi_segment_t, &abandoned_huge) == NULL) return;
+  mi_segment_t* freed = NULL;
+  mi_abandoned_huge_lock_acquire();
+  mi_segment_t* segment = mi_atomic_load_ptr_relaxed(mi_segment_t, &abandoned_huge);
+  while (segment != NULL) {
+    mi_segment_t* const next = mi_atomic_load_ptr_relaxed(mi_segment_t, &segment->abandoned_next);
+    const mi_slice_t* end;
+    mi_page_t* const page = mi_slice_to_page(mi_slices_start_iterate(segment, &end));
+    if (mi_page_thread_free(page) != NULL && mi_abandoned_huge_claim_locked(segment, heap->thread_id)) {
+      mi_atomic_store_ptr_relaxed(mi_segment_t, &segment->abandoned_next, freed);
+      freed = segment;
+    }
+    segment = next;
+  }
+  mi_abandoned_huge_lock_release();
+  while (freed != NULL) {
+    segment = freed;
+    freed = mi_atomic_load_ptr_relaxed(mi_segment_t, &segment->abandoned_next);
+    mi_atomic_store_ptr_release(mi_segment_t, &segment->abandoned_next, NULL);
+    mi_segment_reclaim(segment, heap, 0, NULL, tld);  // frees the segment as its block is free
+  }
 }
 
 static mi_segment_t* mi_segment_try_reclaim(mi_heap_t* heap, size_t needed_slices, size_t block_size, bool* reclaimed, mi_segments_tld_t* tld)
@@ -1366,7 +1709,9 @@ static mi_segment_t* mi_segment_try_reclaim(mi_heap_t* heap, size_t needed_slice
   long max_tries = mi_option_get_clamp(mi_option_max_segment_reclaim, 8, 1024);     // limit the work to bound allocation times  
   while ((max_tries-- > 0) && ((segment = mi_abandoned_pop()) != NULL)) {
     segment->abandoned_visits++;
-    bool has_page = mi_segment_check_free(segment,needed_slices,block_size,tld); // try to free up pages (due to concurrent frees)
+    // only visit all slices if the summary shows the segment may have space for this allocation
+    bool has_page = (mi_segment_abandoned_may_fit(segment,needed_slices,block_size) && 
+                     mi_segment_check_free(segment,needed_slices,block_size,tld)); // try to free up pages (due to concurrent frees)
     if (segment->used == 0) {
       // free the segment (by forced reclaim) to make it available to other threads.
       // note1: we prefer to free a segment as that might lead to reclaiming another
@@ -1402,6 +1747,7 @@ void _mi_abandoned_collect(mi_heap_t* heap, bool force, mi_segments_tld_t* tld)
   if (force) {
     mi_abandoned_visited_revisit(); 
   }
+  mi_abandoned_huge_collect(heap, tld);
   while ((max_tries-- > 0) && ((segment = mi_abandoned_pop()) != NULL)) {
     mi_segment_check_free(segment,0,0,tld); // try to free up pages (due to concurrent frees)
     if (segment->used == 0) {
@@ -1454,7 +1800,7 @@ static mi_page_t* mi_segments_page_alloc(mi_heap_t* heap, mi_page_kind_t page_ki
   mi_assert_internal(required <= MI_LARGE_OBJ_SIZE_MAX && page_kind <= MI_PAGE_LARGE);
 
   // find a free page
-  size_t page_size = _mi_align_up(required, (required > MI_MEDIUM_PAGE_SIZE ? MI_MEDIUM_PAGE_SIZE : MI_SEGMENT_SLICE_SIZE));
+  size_t page_size = _mi_align_up(required, MI_SEGMENT_SLICE_SIZE);
   size_t slices_needed = page_size / MI_SEGMENT_SLICE_SIZE;
   mi_assert_internal(slices_needed * MI_SEGMENT_SLICE_SIZE == page_size);
   mi_page_t* page = mi_segments_page_find_and_allocate(slices_needed, tld); //(required <= MI_SMALL_SIZE_MAX ? 0 : slices_needed), tld);
@@ -1488,40 +1834,199 @@ static mi_page_t* mi_segment_huge_page_alloc(size_t size, mi_segments_tld_t* tld
   if (segment == NULL || page==NULL) return NULL;
   mi_assert_internal(segment->used==1);
   mi_assert_internal(mi_page_block_size(page) >= size);  
-  segment->thread_id = 0; // huge segments are immediately abandoned
   return page;
 }
 
-// free huge block from another thread
-void _mi_segment_huge_page_free(mi_segment_t* segment, mi_page_t* page, mi_block_t* block) {
-  // huge page segments are always abandoned and can be freed immediately by any thread
-  mi_assert_internal(segment->kind==MI_SEGMENT_HUGE);
+// free a huge block from another thread: the page is unlinked from the owning heap
+// and the segment is freed right away (into the huge segment cache).
+// Returns `false` if the owning heap must free the page instead (see `_mi_page_huge_unlink`).
+bool _mi_segment_huge_page_free(mi_segment_t* segment, mi_page_t* page, mi_block_t* block) {
+  mi_assert_internal(segment->kind == MI_SEGMENT_HUGE);
   mi_assert_internal(segment == _mi_page_segment(page));
-  mi_assert_internal(mi_atomic_load_relaxed(&segment->thread_id)==0);
-
-  // claim it and free
-  mi_heap_t* heap = mi_heap_get_default(); // issue #221; don't use the internal get_default_heap as we need to ensure the thread is initialized.
-  // paranoia: if this it the last reference, the cas should always succeed
-  size_t expected_tid = 0;
-  if (mi_atomic_cas_strong_acq_rel(&segment->thread_id, &expected_tid, heap->thread_id)) {
+  mi_assert_internal(page->used == 1); // this is called just before the free
+  mi_assert_internal(page->free == NULL);
+  mi_heap_t* const heap = mi_heap_get_default();
+  if (!mi_heap_is_initialized(heap)) return false;
+  if (mi_atomic_load_relaxed(&segment->thread_id) == 0) {
+    // the owning thread is gone: claim the abandoned segment and free it
+    if (!mi_abandoned_huge_claim(segment, heap->thread_id)) return false;  // not yet pushed by the abandoning thread
     mi_block_set_next(page, block, page->free);
     page->free = block;
     page->used--;
     page->is_zero = false;
     mi_assert(page->used == 0);
-    mi_tld_t* tld = heap->tld;
-    _mi_segment_page_free(page, true, &tld->segments);
+    mi_segment_t* const res = mi_segment_reclaim(segment, heap, 0, NULL, &heap->tld->segments);
+    MI_UNUSED(res); mi_assert_internal(res == NULL);
+    return true;
+  }
+  if (!_mi_page_huge_unlink(page)) return false;
+
+  // the page is no longer reachable from the owning heap; claim and free it
+  mi_atomic_store_release(&segment->thread_id, heap->thread_id);
+  mi_block_set_next(page, block, page->free);
+  page->free = block;
+  page->used--;
+  page->is_zero = false;
+  mi_assert(page->used == 0);
+  mi_tld_t* const tld = heap->tld;
+  _mi_segment_page_free(page, true, &tld->segments);
+  return true;
+}
+
+// reset the memory of a huge block that is freed from another thread
+// (the owning heap frees the page and segment once it collects its delayed frees)
+void _mi_segment_huge_page_reset(mi_segment_t* segment, mi_page_t* page, mi_block_t* block) {
+  MI_UNUSED(page);
+  mi_assert_internal(segment->kind == MI_SEGMENT_HUGE);
+  mi_assert_internal(segment == _mi_page_segment(page));
+  mi_assert_internal(page->used == 1); // this is called just before the free
+  mi_assert_internal(page->free == NULL);
+  if (segment->allow_decommit) {
+    const size_t usize = mi_usable_size(block);
+    if (usize > sizeof(mi_block_t)) {
+      // keep the first word as that is used for the thread free list
+      _mi_os_reset((uint8_t*)block + sizeof(mi_block_t), usize - sizeof(mi_block_t), &_mi_stats_main);
+    }
+  }
+}
+
+/* -----------------------------------------------------------
+   Resize a page with a single large block in place
+----------------------------------------------------------- */
+
+// Grow a page by taking slices from the free span that directly follows it,
+// or shrink it by freeing its tail slices (coalescing with a following free span).
+bool _mi_segment_page_try_resize(mi_page_t* page, size_t page_size, mi_segments_tld_t* tld) {
+  mi_segment_t* segment = _mi_page_segment(page);
+  mi_assert_internal(segment->kind != MI_SEGMENT_HUGE);
+  mi_assert_internal(segment->thread_id == _mi_thread_id());
+  mi_assert_internal(page->reserved == 1 && page->used == 1);
+  mi_assert_internal(page_size > 0 && page_size <= MI_LARGE_OBJ_SIZE_MAX && (page_size % MI_SEGMENT_SLICE_SIZE) == 0);
+  mi_slice_t* slice = mi_page_to_slice(page);
+  const size_t slice_index = mi_slice_index(slice);
+  const size_t slice_count = page_size / MI_SEGMENT_SLICE_SIZE;
+  const size_t current = slice->slice_count;
+  if (slice_count == current) return true;
+
+  if (slice_count < current) {
+    // shrink: the tail slices become a free span (which is coalesced with a free span that follows)
+    mi_slice_t* tail = &segment->slices[slice_index + slice_count];
+    tail->slice_count = (uint32_t)(current - slice_count);
+    tail->slice_offset = 0;
+    tail->xblock_size = 0;
+    slice->slice_count = (uint32_t)slice_count;
+    slice->xblock_size = (uint32_t)page_size;
+    mi_segment_span_free_coalesce(tail, tld);
   }
-#if (MI_DEBUG!=0)
   else {
-    mi_assert_internal(false);
+    // grow: take the needed slices from the free span that follows
+    mi_slice_t* next = slice + current;
+    const size_t extra = slice_count - current;
+    if (next >= mi_segment_slices_end(segment) || next->xblock_size != 0 || next->slice_count < extra) return false;
+    mi_assert_internal(next->slice_offset == 0);
+    if (!mi_segment_ensure_committed(segment, mi_slice_start(next), extra * MI_SEGMENT_SLICE_SIZE, tld->stats)) return false;
+    mi_segment_span_remove_from_queue(next, tld);
+    const size_t next_count = next->slice_count;
+    if (next_count > extra) {
+      mi_segment_span_free(segment, slice_index + slice_count, next_count - extra, tld);
+    }
+    // set the back offsets for the new slices (as for any large page)
+    for (size_t i = current; i < slice_count; i++) {
+      mi_slice_t* s = &segment->slices[slice_index + i];
+      s->slice_offset = (uint32_t)(sizeof(mi_slice_t)*i);
+      s->slice_count = 0;
+      s->xblock_size = 1;
+    }
+    slice->slice_count = (uint32_t)slice_count;
+    slice->xblock_size = (uint32_t)page_size;
   }
-#endif
+  mi_assert_internal(mi_page_block_size(page) == page_size);
+  mi_assert_expensive(mi_segment_is_valid(segment, tld));
+  return true;
+}
+
+
+/* -----------------------------------------------------------
+   Side tables with one bit per word of the segment for mark bits
+   and live bits (if `MI_LIVE_BITS` is set). Only block starts
+   have their bit set.
+----------------------------------------------------------- */
+
+static _Atomic(uintptr_t)* mi_segment_bits(mi_segment_t* segment, _Atomic(uintptr_t*)* table, bool create) {
+  uintptr_t* bits = mi_atomic_load_ptr_acquire(uintptr_t, table);
+  if (bits != NULL || !create) return (_Atomic(uintptr_t)*)bits;
+  // allocate fresh zero'd memory; only the parts that are touched become resident
+  uintptr_t* fresh = (uintptr_t*)_mi_os_alloc(MI_SEGMENT_MARKS_SIZE, &_mi_stats_main);
+  if (fresh == NULL) {
+    _mi_error_message(ENOMEM, "unable to allocate a bit table for segment %p\n", (void*)segment);
+    return NULL;
+  }
+  while (!mi_atomic_cas_ptr_weak_acq_rel(uintptr_t, table, &bits, fresh)) {
+    if (bits != NULL) {
+      // another thread was first
+      _mi_os_free(fresh, MI_SEGMENT_MARKS_SIZE, &_mi_stats_main);
+      return (_Atomic(uintptr_t)*)bits;
+    }
+  }
+  return (_Atomic(uintptr_t)*)fresh;
+}
+
+static void mi_segment_bits_free(_Atomic(uintptr_t*)* table) {
+  uintptr_t* bits = mi_atomic_load_ptr_relaxed(uintptr_t, table);
+  if (bits != NULL) {
+    mi_atomic_store_ptr_release(uintptr_t, table, NULL);
+    _mi_os_free(bits, MI_SEGMENT_MARKS_SIZE, &_mi_stats_main);
+  }
+}
+
+// Clear the bits of all words in `[start, start+size)`
+static void mi_segment_bits_clear(_Atomic(uintptr_t)* bits, const mi_segment_t* segment, const void* start, size_t size) {
+  if (bits == NULL || size == 0) return;
+  const size_t max_bits = MI_SEGMENT_MARKS_SIZE * 8;
+  size_t from = ((size_t)((const uint8_t*)start - (const uint8_t*)segment)) / MI_INTPTR_SIZE;
+  size_t to = from + _mi_divide_up(size, MI_INTPTR_SIZE);    // exclusive
+  if (to > max_bits) to = max_bits;                           // huge segments: only the start can be set
+  while (from < to) {
+    const size_t idx = from / MI_INTPTR_BITS;
+    const size_t bit = from % MI_INTPTR_BITS;
+    const size_t count = (to - from < MI_INTPTR_BITS - bit ? to - from : MI_INTPTR_BITS - bit);
+    if (count == MI_INTPTR_BITS) {
+      mi_atomic_store_relaxed(&bits[idx], (uintptr_t)0);
+    }
+    else {
+      const uintptr_t mask = (((uintptr_t)1 << count) - 1) << bit;
+      mi_atomic_and_acq_rel(&bits[idx], ~mask);
+    }
+    from += count;
+  }
+}
+
+_Atomic(uintptr_t)* _mi_segment_marks(mi_segment_t* segment, bool create) {
+  return mi_segment_bits(segment, &segment->marks, create);
+}
+
+void _mi_segment_marks_clear(mi_segment_t* segment, const void* start, size_t size) {
+  mi_segment_bits_clear(_mi_segment_marks(segment, false), segment, start, size);
 }
 
+
 /* -----------------------------------------------------------
    Page allocation and free
 ----------------------------------------------------------- */
+
+#define MI_LARGE_PAGE_TARGET_SIZE   (MI_SEGMENT_SIZE/32)  // 2MiB on 64-bit
+#define MI_LARGE_PAGE_MAX_BLOCKS    (8)
+
+// Large objects in a size class share a page with a few other blocks of that class
+// (at least 2, about `MI_LARGE_PAGE_TARGET_SIZE` in total); larger objects get a page of their own.
+static size_t mi_segment_large_page_size(size_t block_size) {
+  if (block_size > MI_LARGE_BIN_OBJ_SIZE_MAX) return block_size;
+  size_t blocks = MI_LARGE_PAGE_TARGET_SIZE / block_size;
+  if (blocks < 2) blocks = 2;
+  else if (blocks > MI_LARGE_PAGE_MAX_BLOCKS) blocks = MI_LARGE_PAGE_MAX_BLOCKS;
+  return blocks*block_size;
+}
+
 mi_page_t* _mi_segment_page_alloc(mi_heap_t* heap, size_t block_size, mi_segments_tld_t* tld, mi_os_tld_t* os_tld) {
   mi_page_t* page;
   if (block_size <= MI_SMALL_OBJ_SIZE_MAX) {
@@ -1531,7 +2036,7 @@ mi_page_t* _mi_segment_page_alloc(mi_heap_t* heap, size_t block_size, mi_segment
     page = mi_segments_page_alloc(heap,MI_PAGE_MEDIUM,MI_MEDIUM_PAGE_SIZE,block_size,tld, os_tld);
   }
   else if (block_size <= MI_LARGE_OBJ_SIZE_MAX) {
-    page = mi_segments_page_alloc(heap,MI_PAGE_LARGE,block_size,block_size,tld, os_tld);
+    page = mi_segments_page_alloc(heap,MI_PAGE_LARGE,mi_segment_large_page_size(block_size),block_size,tld, os_tld);
   }
   else {
     page = mi_segment_huge_page_alloc(block_size,tld,os_tld);
@@ -1540,35 +2045,46 @@ mi_page_t* _mi_segment_page_alloc(mi_heap_t* heap, size_t block_size, mi_segment
   return page;
 }
 
+static void mi_segment_walk_through_abandoned_blocks(mi_segment_t* segment, mi_iterate_info_t* iterate_info) {
+  const mi_slice_t* end;
+  mi_slice_t* slice = mi_slices_start_iterate(segment, &end);
+  while (slice < end) {
+    mi_assert_internal(slice->slice_count > 0);
+    mi_assert_internal(slice->slice_offset == 0);
+    if (mi_slice_is_used(slice)) { // used page
+      mi_page_t* const page = mi_slice_to_page(slice);
+      if (!mi_page_all_free(page)) {
+        uint8_t* block = _mi_page_start(segment, page, NULL);
+        uint8_t* end   = block + (page->capacity * mi_page_block_size(page));
+        size_t block_size = mi_page_block_size(page);
+        while(block < end) {
+          uint8_t* next = (uint8_t*)(block + block_size);
+          if ((uintptr_t)block >= iterate_info->start_ptr && (uintptr_t)block < iterate_info->end_ptr) {
+            iterate_info->callback(block, block_size, iterate_info->arg);
+          }
+          block = next;
+        }
+      }
+    }
+    mi_assert_internal(slice->slice_count>0 && slice->slice_offset==0);
+    slice = slice + slice->slice_count;
+  }
+}
+
 void mi_segment_walk_through_abandoned_segments(mi_iterate_info_t* iterate_info) {
   mi_abandoned_visited_revisit();
   mi_tagged_segment_t ts = mi_atomic_load_relaxed(&abandoned);
   mi_segment_t* segment = mi_tagged_segment_ptr(ts);
-
   while (segment != NULL) {
-    const mi_slice_t* end;
-    mi_slice_t* slice = mi_slices_start_iterate(segment, &end);
-    while (slice < end) {
-      mi_assert_internal(slice->slice_count > 0);
-      mi_assert_internal(slice->slice_offset == 0);
-      if (mi_slice_is_used(slice)) { // used page
-        mi_page_t* const page = mi_slice_to_page(slice);
-        if (!mi_page_all_free(page)) {
-          uint8_t* block = _mi_page_start(segment, page, NULL);
-          uint8_t* end   = block + (page->capacity * mi_page_block_size(page));
-          size_t block_size = mi_page_block_size(page);
-          while(block < end) {
-            uint8_t* next = (uint8_t*)(block + block_size);
-            if ((uintptr_t)block >= iterate_info->start_ptr && (uintptr_t)block < iterate_info->end_ptr) {
-              iterate_info->callback(block, block_size, iterate_info->arg);
-            }
-            block = next;
-          }
-        }
-      }
-      mi_assert_internal(slice->slice_count>0 && slice->slice_offset==0);
-      slice = slice + slice->slice_count;
-    }
+    mi_segment_walk_through_abandoned_blocks(segment, iterate_info);
+    segment = mi_atomic_load_ptr_relaxed(mi_segment_t, &segment->abandoned_next);
+  }
+  // abandoned huge segments; the lock keeps them from being freed while we visit them
+  mi_abandoned_huge_lock_acquire();
+  segment = mi_atomic_load_ptr_relaxed(mi_segment_t, &abandoned_huge);
+  while (segment != NULL) {
+    mi_segment_walk_through_abandoned_blocks(segment, iterate_info);
     segment = mi_atomic_load_ptr_relaxed(mi_segment_t, &segment->abandoned_next);
   }
+  mi_abandoned_huge_lock_release();
 }
\ No newline at end of file
@@ -117,6 +117,7 @@ static void mi_stats_add(mi_stats_t* stats, const mi_stats_t* src) {
   mi_stat_counter_add(&stats->commit_calls, &src->commit_calls, 1);
 
   mi_stat_counter_add(&stats->page_no_retire, &src->page_no_retire, 1);
+  mi_stat_counter_add(&stats->page_retire_hit, &src->page_retire_hit, 1);
   mi_stat_counter_add(&stats->searches, &src->searches, 1);
   mi_stat_counter_add(&stats->normal_count, &src->normal_count, 1);
   mi_stat_counter_add(&stats->huge_count, &src->huge_count, 1);
@@ -248,6 +249,14 @@ static void mi_stat_counter_print_avg(const mi_stat_counter_t* stat, const char*
   _mi_fprintf(out, arg, "%10s: %5" PRId64 ".%" PRId8 " avg\n", msg, avg_whole, avg_frac1);
 }
 
+// print `stat` together with its percentage of `base`
+static void mi_stat_counter_print_rate(const mi_stat_counter_t* stat, const mi_stat_counter_t* base, const char* msg, mi_output_fun* out, void* arg) {
+  const int64_t rate_tens = (base->total == 0 ? 0 : (stat->total*1000 / base->total));
+  _mi_fprintf(out, arg, "%10s:", msg);
+  mi_print_amount(stat->total, -1, out, arg);
+  _mi_fprintf(out, arg, " %5" PRId64 ".%" PRId64 " %%\n", rate_tens/10, rate_tens%10);
+}
+
 typedef struct {
   int64_t avg_whole;
   int8_t avg_frac;
@@ -383,11 +392,17 @@ static void _mi_stats_print(mi_stats_t* stats, mi_output_fun* out0, void* arg0)
   mi_stat_print(&stats->pages_abandoned, "-abandoned", -1, out, arg);
   mi_stat_counter_print(&stats->pages_extended, "-extended", out, arg);
   mi_stat_counter_print(&stats->page_no_retire, "-noretire", out, arg);
+  mi_stat_counter_print_rate(&stats->page_retire_hit, &stats->page_no_retire, "-reused", out, arg);
   mi_stat_counter_print(&stats->mmap_calls, "mmaps", out, arg);
   mi_stat_counter_print(&stats->commit_calls, "commits", out, arg);
   mi_stat_print(&stats->threads, "threads", -1, out, arg);
   mi_stat_counter_print_avg(&stats->searches, "searches", out, arg);
   _mi_fprintf(out, arg, "%10s: %7zu\n", "numa nodes", _mi_os_numa_node_count());
+  size_t vma_max = 0;
+  const size_t vma_count = _mi_os_vma_count(true, &vma_max);
+  if (vma_max > 0) {
+    _mi_fprintf(out, arg, "%10s: %7zu (of at most %zu)\n", "mappings", vma_count, vma_max);
+  }
   
   mi_msecs_t elapsed;
   mi_msecs_t user_time;
@@ -628,6 +643,7 @@ static void mi_stats_print_pages_xml(const mi_stats_t *stats, mi_output_fun *out
   mi_stat_print_xml_element(&stats->pages_abandoned, "abandoned", -1, out, arg);
   mi_stat_counter_print_xml(&stats->pages_extended, "extended", out, arg);
   mi_stat_counter_print_xml(&stats->page_no_retire, "noretire", out, arg);
+  mi_stat_counter_print_xml(&stats->page_retire_hit, "reused", out, arg);
   _mi_fprintf(out, arg, "</pages>\n");
 }
 
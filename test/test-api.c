@@ -26,12 +26,21 @@ we therefore test the API over various inputs. Please add more tests :-)
 #include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
 #ifdef __cplusplus
 #include <vector>
 #endif
 
+#if defined(__linux__)
+#include <stdio.h>
+#include <unistd.h>    // fork
+#include <sys/wait.h>  // waitpid
+#include <pthread.h>
+#endif
+
 #include "mimalloc.h"
 // #include "mimalloc-internal.h"
 #include "mimalloc-types.h" // for MI_DEBUG
@@ -43,6 +52,17 @@ we therefore test the API over various inputs. Please add more tests :-)
 // ---------------------------------------------------------------------------
 bool test_heap1(void);
 bool test_heap2(void);
+bool test_heap_huge(void);
+bool test_huge_cache_rss(void);
+bool test_deferred_free_ex(void);
+bool test_hooks(void);
+bool test_block_info_batch(void);
+bool test_mark_sweep(void);
+bool test_heap_free_if(void);
+bool test_heap_adopt_page(void);
+bool test_exclude_from_fork(void);
+bool test_reclaim_iterate(void);
+bool test_grow_buffer(void);
 bool test_stl_allocator1(void);
 bool test_stl_allocator2(void);
 
@@ -76,6 +96,35 @@ int main(void) {
     void* p = mi_malloc(67108872);
     mi_free(p);
   });
+  CHECK_BODY("realloc-growth",{  // grow a buffer one byte at a time
+    uint8_t* p = NULL;
+    size_t capacity = 0;
+    size_t moves = 0;
+    for (size_t len = 0; len < 1024*1024 && result; len++) {
+      if (len >= capacity) {
+        uint8_t* q = (uint8_t*)mi_realloc_growth(p, len + 1, &capacity);
+        result = (q != NULL && capacity >= len + 1 && capacity == mi_usable_size(q));
+        if (q != p) { moves++; }
+        p = q;
+      }
+      if (result) { p[len] = (uint8_t)len; }
+    }
+    for (size_t i = 0; i < 1024*1024 && result; i += 1000) { result = (p[i] == (uint8_t)i); }
+    result = result && (moves < 40);
+    mi_free(p);
+  });
+  CHECK_BODY("malloc-huge-reuse",{  // reuse (and trim) cached huge segments
+    result = true;
+    for (size_t i = 0; i < 8 && result; i++) {
+      size_t size = (size_t)(200 - 20*i) * 1024 * 1024;
+      uint8_t* p = (uint8_t*)mi_malloc(size);
+      result = (p != NULL && mi_usable_size(p) >= size);
+      if (p != NULL) { p[0] = 1; p[size-1] = 1; }
+      mi_free(p);
+    }
+    mi_collect(true);
+  });
+  CHECK("malloc-huge-cache-rss", test_huge_cache_rss());
 
   // ---------------------------------------------------
   // Extended
@@ -179,18 +228,41 @@ int main(void) {
   // ---------------------------------------------------
   CHECK("heap_destroy", test_heap1());
   CHECK("heap_delete", test_heap2());
+  CHECK("heap_huge", test_heap_huge());
 
   //mi_stats_print(NULL);
 
   // ---------------------------------------------------
   // various
   // ---------------------------------------------------
+  CHECK("deferred_free_ex", test_deferred_free_ex());
+  CHECK("hooks", test_hooks());
+  CHECK("block_info_batch", test_block_info_batch());
+  CHECK("mark_sweep", test_mark_sweep());
+  CHECK("heap_free_if", test_heap_free_if());
+  CHECK("heap_adopt_page", test_heap_adopt_page());
+  CHECK("exclude_from_fork", test_exclude_from_fork());
+  CHECK("reclaim_iterate", test_reclaim_iterate());
+  CHECK_BODY("block_start", {
+    uint8_t* small = (uint8_t*)mi_malloc(40);
+    uint8_t* large = (uint8_t*)mi_malloc(3*1024*1024);
+    uint8_t* huge  = (uint8_t*)mi_malloc(100*1024*1024);
+    size_t size = 1;
+    int local = 0;
+    result = (mi_block_start(small + 17, &size) == small && size >= mi_usable_size(small) &&
+              mi_block_start(large + 2*1024*1024, &size) == large && size >= mi_usable_size(large) &&
+              mi_block_start(huge + 90*1024*1024, NULL) == huge &&
+              mi_block_start(&local, &size) == NULL && size == 0 &&
+              mi_block_start(NULL, NULL) == NULL);
+    mi_free(huge); mi_free(large); mi_free(small);
+  });
   CHECK_BODY("realpath", {
     char* s = mi_realpath( ".", NULL );
     // printf("realpath: %s\n",s);
     mi_free(s);
   });
 
+  CHECK("grow_buffer", test_grow_buffer());
   CHECK("stl_allocator1", test_stl_allocator1());
   CHECK("stl_allocator2", test_stl_allocator2());
 
@@ -224,6 +296,455 @@ bool test_heap2() {
   return true;
 }
 
+static bool test_heap_count_blocks(const mi_heap_t* heap, const mi_heap_area_t* area, void* block, size_t block_size, void* arg) {
+  (void)(heap); (void)(area); (void)(block_size);
+  if (block != NULL) { *((size_t*)arg) += 1; }
+  return true;
+}
+
+static bool test_heap_count_areas(const mi_heap_t* heap, const mi_heap_area_t* area, void* block, size_t block_size, void* arg) {
+  (void)(heap); (void)(area); (void)(block_size);
+  if (block == NULL) { *((size_t*)arg) += 1; }
+  return true;
+}
+
+#if defined(__linux__)
+static void* test_free_block(void* p) {
+  mi_free(mi_malloc(8));  // initialize the heap of this thread
+  mi_free(p);
+  return NULL;
+}
+
+static void* test_alloc_huge(void* arg) {
+  *(void**)arg = mi_malloc(80*1024*1024);
+  return NULL;  // exit so the huge segment is abandoned
+}
+
+static void test_find_block(void* base, size_t size, void* arg) {
+  (void)(size);
+  if (base == *(void**)arg) { *(void**)arg = NULL; }
+}
+#endif
+
+#if defined(__linux__)
+static long test_rss_kib(void) {
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f == NULL) return -1;
+  long size = 0, resident = -1;
+  if (fscanf(f, "%ld %ld", &size, &resident) != 2) resident = -1;
+  fclose(f);
+  return (resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024));
+}
+#endif
+
+bool test_huge_cache_rss() {
+#if defined(__linux__)
+  // a freed huge segment is cached, but its memory is released once the delay has passed
+  const long delay = mi_option_get(mi_option_segment_decommit_delay);
+  mi_option_set(mi_option_segment_decommit_delay, 10);
+  const size_t size = 100*1024*1024;
+  uint8_t* p = (uint8_t*)mi_malloc(size);
+  if (p == NULL) return false;
+  memset(p, 1, size);
+  size_t commit_used = 0, commit_freed = 0;
+  mi_process_info(NULL, NULL, NULL, NULL, NULL, &commit_used, NULL, NULL);
+  const long rss_used = test_rss_kib();
+  mi_free(p);
+  usleep(50*1000);
+  mi_collect(false);
+  mi_process_info(NULL, NULL, NULL, NULL, NULL, &commit_freed, NULL, NULL);
+  const long rss_freed = test_rss_kib();
+  mi_option_set(mi_option_segment_decommit_delay, delay);
+  bool ok = (commit_freed + 64*1024*1024 < commit_used);
+  #if defined(NDEBUG)
+  // (in debug mode decommitted memory is only protected and stays resident)
+  ok = ok && (rss_used > 0 && rss_freed >= 0 && rss_freed + 64*1024 < rss_used);
+  #else
+  (void)(rss_used); (void)(rss_freed);
+  #endif
+  return ok;
+#else
+  return true;
+#endif
+}
+
+bool test_heap_huge() {
+  // huge blocks are owned by their heap: visible in heap walks and freed by `mi_heap_destroy`
+  mi_heap_t* heap = mi_heap_new();
+  uint8_t* p = (uint8_t*)mi_heap_malloc(heap, 80*1024*1024);
+  if (p == NULL) return false;
+  p[0] = 1;
+  size_t count = 0;
+  mi_heap_visit_blocks(heap, true, &test_heap_count_blocks, &count);
+  bool ok = (count == 1 && mi_heap_check_owned(heap, p) && mi_heap_contains_block(heap, p));
+  #if defined(__linux__)
+  // but a huge block freed by another thread is taken out of its heap right away
+  uint8_t* q = (uint8_t*)mi_heap_malloc(heap, 80*1024*1024);
+  pthread_t t;
+  if (q == NULL || pthread_create(&t, NULL, &test_free_block, q) != 0 || pthread_join(t, NULL) != 0) {
+    ok = false;
+  }
+  count = 0;
+  mi_heap_visit_blocks(heap, true, &test_heap_count_blocks, &count);
+  ok = ok && (count == 1 && !mi_heap_check_owned(heap, q));
+  // and a huge block of a thread that exited is freed right away by any thread
+  void* r = NULL;
+  if (pthread_create(&t, NULL, &test_alloc_huge, &r) != 0 || pthread_join(t, NULL) != 0 || r == NULL) {
+    ok = false;
+  }
+  else {
+    void* find = r;
+    mi_malloc_disable();
+    mi_malloc_iterate(NULL, SIZE_MAX, &test_find_block, &find);
+    mi_malloc_enable();
+    ok = ok && (find == NULL && mi_is_in_heap_region(r));
+    mi_free(r);
+    ok = ok && !mi_is_in_heap_region(r);
+  }
+  #endif
+  mi_heap_destroy(heap);
+  return ok;
+}
+
+typedef struct test_deferred_s {
+  size_t calls;
+  size_t forced;
+  bool   committed;
+} test_deferred_t;
+
+static void test_deferred_fun(const mi_deferred_free_info_t* info, void* arg) {
+  test_deferred_t* d = (test_deferred_t*)arg;
+  d->calls++;
+  if (info->force) d->forced++;
+  if (info->committed > 0) d->committed = true;
+}
+
+bool test_deferred_free_ex() {
+  test_deferred_t every = { 0, 0, false };
+  test_deferred_t rarely = { 0, 0, false };
+  if (!mi_register_deferred_free_ex(&test_deferred_fun, &every, 1, 0)) return false;
+  if (!mi_register_deferred_free_ex(&test_deferred_fun, &rarely, 64, 10)) return false;
+  for (int i = 0; i < 256; i++) {
+    mi_free(mi_malloc(64*1024));  // medium objects go through the generic allocation path
+  }
+  mi_collect(true);
+  mi_unregister_deferred_free_ex(&test_deferred_fun, &every);
+  mi_unregister_deferred_free_ex(&test_deferred_fun, &rarely);
+  const size_t calls = every.calls;
+  mi_free(mi_malloc(64*1024));
+  return (every.calls >= 256 && every.committed && every.forced == 1 &&
+          rarely.calls > 0 && rarely.calls < every.calls && rarely.forced == 1 &&
+          every.calls == calls);  // no longer called
+}
+
+typedef struct test_hooks_s {
+  size_t allocs;
+  size_t frees;
+  size_t reallocs;
+  void*  last;
+} test_hooks_t;
+
+static void test_on_alloc(void* p, size_t size, void* arg) {
+  test_hooks_t* h = (test_hooks_t*)arg;
+  h->allocs++; h->last = p;
+  mi_free(mi_malloc(size));  // allocations inside a hook are not reported
+}
+
+static void test_on_free(void* p, void* arg) {
+  test_hooks_t* h = (test_hooks_t*)arg;
+  h->frees++; h->last = p;
+}
+
+static void test_on_realloc(void* p, void* newp, size_t newsize, void* arg) {
+  test_hooks_t* h = (test_hooks_t*)arg;
+  (void)(p); (void)(newsize);
+  h->reallocs++; h->last = newp;
+}
+
+bool test_hooks() {
+  test_hooks_t h = { 0, 0, 0, NULL };
+  bool ok = true;
+  mi_register_hooks(&test_on_alloc, &test_on_free, &test_on_realloc, &h);
+  void* p = mi_malloc(32);
+  ok = ok && (h.allocs == 1 && h.last == p);
+  void* q = mi_malloc(100000);
+  ok = ok && (h.allocs == 2 && h.last == q);
+  void* a = mi_malloc_aligned(100, 256);  // over-allocates internally
+  ok = ok && (h.allocs == 3 && h.last == a);
+  p = mi_realloc(p, 1000);
+  ok = ok && (h.allocs == 3 && h.frees == 0 && h.reallocs == 1 && h.last == p);
+  mi_free(a); mi_free(q); mi_free(p);
+  ok = ok && (h.frees == 3 && h.last == p);
+  // without a realloc hook, reallocation is reported as a free and an allocation
+  mi_register_hooks(&test_on_alloc, &test_on_free, NULL, &h);
+  p = mi_realloc(NULL, 10);
+  p = mi_realloc(p, 10000);
+  ok = ok && (h.allocs == 5 && h.frees == 4 && h.reallocs == 1 && h.last == p);
+  mi_register_hooks(NULL, NULL, NULL, NULL);
+  mi_free(p);
+  mi_free(mi_malloc(10));
+  ok = ok && (h.allocs == 5 && h.frees == 4);
+  return ok;
+}
+
+static int test_ptr_compare(const void* a, const void* b) {
+  const uintptr_t x = (uintptr_t)(*(void* const*)a);
+  const uintptr_t y = (uintptr_t)(*(void* const*)b);
+  return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+bool test_block_info_batch() {
+  #define TEST_BATCH_N  (200)
+  mi_heap_t* heap = mi_heap_new();
+  void* blocks[TEST_BATCH_N];
+  const void* ptrs[TEST_BATCH_N + 2];
+  size_t sizes[TEST_BATCH_N + 2];
+  mi_ptr_info_t infos[TEST_BATCH_N + 2];
+  for (size_t i = 0; i < TEST_BATCH_N; i++) {
+    const size_t size = (i % 50 == 0 ? 300000 : 8 + (i % 7)*24);
+    blocks[i] = (i % 2 == 0 ? mi_malloc(size) : mi_heap_malloc(heap, size));
+  }
+  qsort(blocks, TEST_BATCH_N, sizeof(void*), &test_ptr_compare);
+  for (size_t i = 0; i < TEST_BATCH_N; i++) { ptrs[i] = blocks[i]; }
+  void* a = mi_malloc_aligned(100, 256);
+  ptrs[TEST_BATCH_N] = a;
+  ptrs[TEST_BATCH_N + 1] = NULL;
+  mi_usable_size_batch(ptrs, TEST_BATCH_N + 2, sizes);
+  mi_block_info_batch(ptrs, TEST_BATCH_N + 2, infos);
+  bool ok = true;
+  for (size_t i = 0; i < TEST_BATCH_N && ok; i++) {
+    ok = (sizes[i] == mi_usable_size(ptrs[i]) && infos[i].block == ptrs[i] &&
+          infos[i].block_size == sizes[i] &&
+          (infos[i].heap == heap) == mi_heap_contains_block(heap, ptrs[i]));
+  }
+  ok = ok && (sizes[TEST_BATCH_N] == mi_usable_size(a) &&
+              infos[TEST_BATCH_N].block <= a &&
+              (uint8_t*)infos[TEST_BATCH_N].block + infos[TEST_BATCH_N].block_size >= (uint8_t*)a + sizes[TEST_BATCH_N] &&
+              infos[TEST_BATCH_N].heap == mi_heap_get_default());
+  ok = ok && (sizes[TEST_BATCH_N + 1] == 0 && infos[TEST_BATCH_N + 1].block == NULL && infos[TEST_BATCH_N + 1].heap == NULL);
+  // pointers that are not from the heap, and interior pointers far into a huge block
+  uint8_t* huge = (uint8_t*)mi_malloc(100*1024*1024);
+  const void* other[3] = { &ok, huge + 90*1024*1024, huge };
+  mi_block_info_batch(other, 3, infos);
+  ok = ok && (huge != NULL && infos[0].block == NULL && infos[0].heap == NULL &&
+              infos[1].block == huge && infos[2].block == huge &&
+              infos[1].block_size == mi_usable_size(huge) && infos[1].heap == mi_heap_get_default());
+  mi_free(huge);
+  mi_free(a);
+  for (size_t i = 0; i < TEST_BATCH_N; i++) { mi_free(blocks[i]); }
+  mi_heap_delete(heap);
+  return ok;
+  #undef TEST_BATCH_N
+}
+
+bool test_mark_sweep() {
+  #define TEST_SWEEP_N  (5000)
+  mi_heap_t* heap = mi_heap_new();
+  void** blocks = (void**)mi_malloc(TEST_SWEEP_N * sizeof(void*));
+  for (size_t i = 0; i < TEST_SWEEP_N; i++) {
+    const size_t size = (i % 1000 == 0 ? 200000 : (i % 100 == 0 ? 20000 : 16 + (i % 5)*16));
+    blocks[i] = (i % 250 == 1 ? mi_heap_malloc_aligned(heap, size, 128) : mi_heap_malloc(heap, size));
+  }
+  // free some blocks directly, and mark every third block
+  size_t expected = 0;
+  for (size_t i = 0; i < TEST_SWEEP_N; i++) {
+    if (i % 7 == 0) { mi_free(blocks[i]); blocks[i] = NULL; }
+    else if (i % 3 == 0) { if (mi_block_mark(blocks[i])) return false; }
+    else { expected++; }
+  }
+  bool ok = (mi_block_is_marked(blocks[3]) && mi_block_mark(blocks[3]) && !mi_block_is_marked(blocks[4]));
+  ok = ok && (mi_heap_sweep_unmarked(heap) == expected);
+  size_t count = 0;
+  mi_heap_visit_blocks(heap, true, &test_heap_count_blocks, &count);
+  ok = ok && (count == TEST_SWEEP_N - expected - (TEST_SWEEP_N + 6)/7);
+  for (size_t i = 0; ok && i < TEST_SWEEP_N; i++) {
+    if (blocks[i] != NULL && i % 3 == 0) {
+      ok = !mi_block_is_marked(blocks[i]);  // the sweep unmarks the survivors
+      mi_free(blocks[i]);
+    }
+  }
+  ok = ok && (mi_heap_sweep_unmarked(heap) == 0);
+  mi_free(blocks);
+  mi_heap_delete(heap);
+  return ok;
+  #undef TEST_SWEEP_N
+}
+
+static bool test_block_is_odd(const mi_heap_t* heap, void* block, size_t block_size, void* arg) {
+  (void)(heap);
+  if (block_size < sizeof(size_t)) return false;
+  *((size_t*)arg) += 1;
+  return ((*(size_t*)block % 2) == 1);
+}
+
+// frees a block of another heap for each visited block
+static bool test_block_free_other(const mi_heap_t* heap, void* block, size_t block_size, void* arg) {
+  (void)(heap); (void)(block); (void)(block_size);
+  void** others = (void**)arg;
+  mi_free(*others);
+  *others = mi_malloc(16);
+  return true;
+}
+
+bool test_heap_free_if() {
+  mi_heap_t* heap = mi_heap_new();
+  size_t allocated = 0;
+  for (size_t i = 0; i < 20000; i++) {
+    size_t* p = (size_t*)mi_heap_malloc(heap, (i % 500 == 0 ? 100000 : 8 + (i % 9)*8));
+    *p = i;
+    allocated++;
+    if (i % 11 == 0) { mi_free(p); allocated--; }  // freed blocks are not visited
+  }
+  size_t visited = 0;
+  const size_t freed = mi_heap_free_if(heap, &test_block_is_odd, &visited);
+  size_t count = 0;
+  mi_heap_visit_blocks(heap, true, &test_heap_count_blocks, &count);
+  bool ok = (visited == allocated && freed > 0 && count == allocated - freed);
+  visited = 0;
+  ok = ok && (mi_heap_free_if(heap, &test_block_is_odd, &visited) == 0 && visited == count);
+  // the predicate can use other heaps
+  void* other = mi_malloc(16);
+  ok = ok && (mi_heap_free_if(heap, &test_block_free_other, &other) == count);
+  mi_free(other);
+  mi_heap_destroy(heap);
+  return ok;
+}
+
+bool test_heap_adopt_page() {
+  mi_heap_t* heap1 = mi_heap_new();
+  mi_heap_t* heap2 = mi_heap_new();
+  // a large block is alone in its page and can be handed off without copying
+  uint8_t* p = (uint8_t*)mi_heap_malloc(heap1, 1024*1024);
+  memset(p, 1, 1024*1024);
+  bool ok = (mi_heap_adopt_page(heap2, p) && mi_heap_contains_block(heap2, p) && !mi_heap_contains_block(heap1, p));
+  // a small block cannot be adopted while its page has other live blocks
+  void* s1 = mi_heap_malloc(heap1, 32);
+  void* s2 = mi_heap_malloc(heap1, 32);
+  ok = ok && !mi_heap_adopt_page(heap2, s1) && mi_heap_contains_block(heap1, s1);
+  mi_free(s2);
+  ok = ok && mi_heap_adopt_page(heap2, s1) && mi_heap_contains_block(heap2, s1);
+  // realloc of a large block into another heap takes over its page
+  uint8_t* q = (uint8_t*)mi_heap_malloc(heap1, 2*1024*1024);
+  uint8_t* r = (uint8_t*)mi_heap_realloc(heap2, q, 3*1024*1024);
+  ok = ok && (r != NULL && mi_heap_contains_block(heap2, r) && !mi_heap_contains_block(heap1, r));
+  // but a block that is reallocated in place, or with `mi_realloc`, stays in its heap
+  uint8_t* u = (uint8_t*)mi_heap_malloc(heap1, 2*1024*1024);
+  ok = ok && (mi_heap_realloc(heap2, u, 2*1024*1024 - 100) == u && mi_heap_contains_block(heap1, u));
+  ok = ok && (mi_realloc(u, 2*1024*1024 - 200) == u && mi_heap_contains_block(heap1, u));
+  #if defined(__linux__)
+  // a page with a block freed by another thread is adopted with its delayed free processed
+  // (right before `heap1` is destroyed so nothing else processes its delayed free list)
+  void* a = mi_heap_malloc(heap1, 48);
+  void* b = mi_heap_malloc(heap1, 48);
+  pthread_t t;
+  if (pthread_create(&t, NULL, &test_free_block, b) != 0 || pthread_join(t, NULL) != 0) { ok = false; }
+  ok = ok && mi_heap_adopt_page(heap2, a) && mi_heap_contains_block(heap2, a);
+  #endif
+  mi_heap_destroy(heap1);   // must not free the adopted blocks
+  for (size_t i = 0; ok && i < 1024*1024; i += 4096) { ok = (p[i] == 1); }
+  memset(r, 2, 3*1024*1024);
+  #if defined(__linux__)
+  // once freed, the adopted small page is freed by the new heap
+  mi_free(a);
+  mi_free(s1);
+  mi_free(p);
+  mi_free(r);
+  mi_heap_collect(heap2, true);
+  size_t count = 0;
+  mi_heap_visit_blocks(heap2, false, &test_heap_count_areas, &count);
+  ok = ok && (count == 0);
+  #endif
+  mi_heap_destroy(heap2);
+  return ok;
+}
+
+bool test_exclude_from_fork() {
+#if defined(__linux__)
+  // blocks allocated before the option is set are still present in the child
+  void* before[64];
+  for (size_t i = 0; i < 64; i++) { before[i] = mi_malloc(1000); }
+  mi_option_set(mi_option_exclude_from_fork, 1);
+  const size_t size = 40*1024*1024;  // a huge block always gets its own segment
+  uint8_t* p = (uint8_t*)mi_malloc(size);
+  memset(p, 1, size);
+  fflush(NULL);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    // the child starts with empty heaps and cannot see the excluded memory of the parent
+    bool ok = !mi_is_in_heap_region(p);
+    for (size_t i = 0; i < 64; i++) {
+      ok = ok && mi_is_in_heap_region(before[i]);
+      mi_free(before[i]);
+    }
+    for (size_t i = 0; i < 64; i++) { before[i] = mi_malloc(1000); }
+    for (size_t i = 0; i < 64; i++) { mi_free(before[i]); }
+    void* q = mi_malloc(32);
+    void* r = mi_malloc(8*1024*1024);
+    ok = ok && (q != NULL && r != NULL && mi_is_in_heap_region(q) && mi_is_in_heap_region(r));
+    if (r != NULL) { memset(r, 2, 8*1024*1024); }
+    mi_free(r);
+    mi_free(q);
+    exit(ok ? 0 : 1);
+  }
+  int status = 0;
+  bool ok = (pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  for (size_t i = 0; ok && i < size; i += 4096) { ok = (p[i] == 1); }
+  mi_free(p);
+  for (size_t i = 0; i < 64; i++) { mi_free(before[i]); }
+  mi_option_set(mi_option_exclude_from_fork, 0);
+  return ok;
+#else
+  return true;
+#endif
+}
+
+#if defined(__linux__)
+static void* small_blocks[100];
+static void* medium_blocks[20];
+
+static void* test_abandon_blocks(void* arg) {
+  (void)(arg);
+  for (size_t i = 0; i < 100; i++) { small_blocks[i] = mi_malloc(48); }
+  for (size_t i = 0; i < 20; i++) { medium_blocks[i] = mi_malloc(1000); }
+  return NULL;  // exit with live blocks so the segment is abandoned
+}
+
+static void test_count_blocks(void* base, size_t size, void* arg) {
+  (void)(size);
+  size_t* counts = (size_t*)arg;
+  for (size_t i = 0; i < 100; i++) { if (base == small_blocks[i]) counts[0]++; }
+  for (size_t i = 0; i < 20; i++) { if (base == medium_blocks[i]) counts[1]++; }
+}
+
+static void* test_reclaim_small(void* arg) {
+  // reclaiming the segment takes all its pages, and all live blocks stay visible
+  void* p = mi_malloc(48);
+  size_t counts[2] = { 0, 0 };
+  mi_malloc_disable();
+  mi_malloc_iterate(NULL, SIZE_MAX, &test_count_blocks, counts);
+  mi_malloc_enable();
+  *(bool*)arg = (counts[0] == 100 && counts[1] == 20 &&
+                 mi_heap_check_owned(mi_heap_get_default(), small_blocks[0]) &&
+                 mi_heap_check_owned(mi_heap_get_default(), medium_blocks[0]));
+  mi_free(p);
+  return NULL;
+}
+#endif
+
+bool test_reclaim_iterate() {
+#if defined(__linux__)
+  bool ok = false;
+  pthread_t t;
+  if (pthread_create(&t, NULL, &test_abandon_blocks, NULL) != 0 || pthread_join(t, NULL) != 0) return false;
+  if (pthread_create(&t, NULL, &test_reclaim_small, &ok) != 0 || pthread_join(t, NULL) != 0) return false;
+  for (size_t i = 0; i < 100; i++) { mi_free(small_blocks[i]); }
+  for (size_t i = 0; i < 20; i++) { mi_free(medium_blocks[i]); }
+  return ok;
+#else
+  return true;
+#endif
+}
+
 bool test_stl_allocator1() {
 #ifdef __cplusplus
   std::vector<int, mi_stl_allocator<int> > vec;
@@ -237,6 +758,25 @@ bool test_stl_allocator1() {
 
 struct some_struct  { int i; int j; double z; };
 
+bool test_grow_buffer() {
+#ifdef __cplusplus
+  some_struct* p = NULL;
+  std::size_t capacity = 0;
+  for (int i = 0; i < 10000; i++) {
+    if ((std::size_t)i >= capacity) {
+      p = mi_grow_buffer(p, i + 1, capacity);
+      if (p == NULL || capacity < (std::size_t)i + 1) return false;
+    }
+    p[i].i = i;
+  }
+  bool ok = (p[9999].i == 9999 && capacity == mi_good_capacity<some_struct>(capacity));
+  mi_free(p);
+  return ok;
+#else
+  return true;
+#endif
+}
+
 bool test_stl_allocator2() {
 #ifdef __cplusplus
   std::vector<some_struct, mi_stl_allocator<some_struct> > vec;
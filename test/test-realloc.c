@@ -0,0 +1,132 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2022, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* Tests re-allocation for common growth patterns and reports their timing:
+   - strings that grow a few bytes at a time,
+   - vectors that double their capacity,
+   - large buffers that grow (and shrink) in place.
+   Use `USE_STD_MALLOC` to compare the timings with the standard allocator.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "mimalloc.h"
+#include "testhelper.h"
+
+// #define USE_STD_MALLOC
+#ifdef USE_STD_MALLOC
+#define custom_realloc(p,s)   realloc(p,s)
+#define custom_free(p)        free(p)
+#else
+#define custom_realloc(p,s)   mi_realloc(p,s)
+#define custom_free(p)        mi_free(p)
+#endif
+
+#define KiB  ((size_t)1024)
+#define MiB  (KiB*KiB)
+
+static double elapsed_msecs(clock_t start) {
+  return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+// grow a string `step` bytes at a time up to `max` bytes
+static bool string_growth(size_t step, size_t max) {
+  char* s = NULL;
+  for (size_t len = 0; len + step <= max; len += step) {
+    s = (char*)custom_realloc(s, len + step + 1);
+    if (s == NULL) return false;
+    memset(s + len, 'a' + (int)((len / step) % 26), step);
+    s[len + step] = 0;
+  }
+  bool ok = true;
+  for (size_t i = 0; ok && i + step <= max; i += step) {
+    ok = (s[i] == 'a' + (int)((i / step) % 26) && s[i + step - 1] == s[i]);
+  }
+  custom_free(s);
+  return ok;
+}
+
+// grow a vector of words by doubling its capacity up to `max` bytes
+static bool vector_growth(size_t max) {
+  uintptr_t* v = NULL;
+  size_t count = 0;
+  for (size_t capacity = 16; capacity*sizeof(uintptr_t) <= max; capacity *= 2) {
+    v = (uintptr_t*)custom_realloc(v, capacity*sizeof(uintptr_t));
+    if (v == NULL) return false;
+    for (; count < capacity; count++) { v[count] = count; }
+  }
+  bool ok = true;
+  for (size_t i = 0; ok && i < count; i += 61) { ok = (v[i] == i); }
+  custom_free(v);
+  return ok;
+}
+
+// grow a large buffer 1MiB at a time, and shrink it again
+static bool large_growth(size_t start, size_t max, size_t* moves) {
+  uint8_t* p = (uint8_t*)custom_realloc(NULL, start);
+  if (p == NULL) return false;
+  memset(p, 1, start);
+  *moves = 0;
+  size_t size = start;
+  for (size_t newsize = start + MiB; newsize <= max; newsize += MiB) {
+    uint8_t* q = (uint8_t*)custom_realloc(p, newsize);
+    if (q == NULL) { custom_free(p); return false; }
+    if (q != p) { *moves += 1; }
+    p = q;
+    memset(p + size, 1, newsize - size);
+    size = newsize;
+  }
+  p = (uint8_t*)custom_realloc(p, start);
+  bool ok = (p != NULL);
+  for (size_t i = 0; ok && i < start; i += 4096) { ok = (p[i] == 1); }
+  custom_free(p);
+  return ok;
+}
+
+int main(void) {
+  mi_option_disable(mi_option_verbose);
+
+  CHECK_BODY("realloc-string", {
+    clock_t start = clock();
+    result = string_growth(1, 64*KiB) && string_growth(7, MiB) && string_growth(4000, 16*MiB);
+    fprintf(stderr, "(%.1f ms) ", elapsed_msecs(start));
+  });
+  CHECK_BODY("realloc-vector", {
+    clock_t start = clock();
+    for (int i = 0; i < 10 && result; i++) {
+      result = vector_growth(64*MiB);
+    }
+    fprintf(stderr, "(%.1f ms) ", elapsed_msecs(start));
+  });
+  CHECK_BODY("realloc-large", {
+    size_t moves = 0;
+    clock_t start = clock();
+    result = large_growth(5*MiB, 30*MiB, &moves);
+    fprintf(stderr, "(%.1f ms, %zu moves) ", elapsed_msecs(start), moves);
+    #ifndef USE_STD_MALLOC
+    result = result && (moves < 10);  // most resizes should be in place
+    #endif
+  });
+  #ifndef USE_STD_MALLOC
+  CHECK_BODY("rezalloc-large", {
+    uint8_t* p = (uint8_t*)mi_zalloc(5*MiB);
+    memset(p, 1, 5*MiB);
+    p = (uint8_t*)mi_rezalloc(p, 5*MiB + 100);
+    p = (uint8_t*)mi_rezalloc(p, 12*MiB);
+    result = (p != NULL);
+    for (size_t i = 5*MiB; result && i < 12*MiB; i++) { result = (p[i] == 0); }
+    mi_free(p);
+  });
+  #endif
+
+  return print_test_summary();
+}
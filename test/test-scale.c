@@ -0,0 +1,388 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2022, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* Multi-threaded scalability benchmark. Runs each workload for a fixed time
+   while sweeping the thread count (1, 2, 4, ... up to twice the number of
+   cores by default) and reports per run:
+   - the throughput in allocations per second,
+   - the peak and steady resident memory (sampled from `/proc/self/statm`;
+     steady is the average over the second half of the run),
+   - the committed memory as reported by `mi_process_info`,
+   - the page faults (minor and major, from `getrusage`) during the run.
+   A run that completes no operations (e.g. on a loaded machine) reports zero
+   throughput; only a failure to start the threads is an error.
+   Results are written as CSV (default) or JSON to plot scaling curves.
+
+   Workloads:
+   - churn   : every thread frees and reallocates same-size blocks,
+   - random  : like churn but with random sizes (8 bytes to 64KiB),
+   - prodcons: pairs of threads where one allocates and the other frees,
+   - threads : every thread keeps starting short-lived threads that allocate,
+   - iterate : churn while one thread iterates all blocks every millisecond (`mi_malloc_iterate`).
+
+   Usage: mimalloc-test-scale [--threads N] [--ms M] [--workload <name>] [--json] [--out <file>]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "mimalloc.h"
+
+#if defined(_WIN32)
+int main(void) {
+  fprintf(stderr, "the scalability benchmark needs pthreads; skipped.\n");
+  return 0;
+}
+#else
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#define MAX_THREADS   (1024)
+#define RING_SIZE     (1024)     // live blocks per thread
+#define QUEUE_SIZE    (4096)     // blocks in flight per producer/consumer pair
+
+static volatile bool stop = false;
+
+// per thread operation counters, padded to avoid false sharing
+typedef struct counter_s {
+  size_t ops;
+  char   pad[64 - sizeof(size_t)];
+} counter_t;
+static counter_t counters[MAX_THREADS];
+
+static uintptr_t pick(uintptr_t* r) {
+  // by Sebastiano Vigna, see: <http://xoshiro.di.unimi.it/splitmix64.c>
+  uint64_t x = *r;
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  *r = (uintptr_t)(x + 0x9e3779b97f4a7c15ULL);
+  return (uintptr_t)x;
+}
+
+static bool stopped(void) {
+  return __atomic_load_n(&stop, __ATOMIC_RELAXED);
+}
+
+static int64_t now_msecs(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((int64_t)t.tv_sec * 1000) + (t.tv_nsec / 1000000);
+}
+
+static long rss_kib(void) {
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f == NULL) return -1;
+  long size = 0, resident = -1;
+  if (fscanf(f, "%ld %ld", &size, &resident) != 2) resident = -1;
+  fclose(f);
+  return (resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024));
+}
+
+// minor and major page faults of the process so far
+// (`mi_process_info` only reports the major ones which are usually zero)
+static size_t page_faults(void) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  return (size_t)(usage.ru_minflt + usage.ru_majflt);
+}
+
+// ---------------------------------------------------------------------------
+// Workloads
+// ---------------------------------------------------------------------------
+
+static size_t random_size(uintptr_t* r) {
+  const uintptr_t x = pick(r);
+  if (x % 100 == 0) return 64*1024;
+  return ((size_t)8 << (x % 10));   // 8 to 4KiB
+}
+
+// free and reallocate blocks in a ring of live blocks
+static void churn(size_t tid, bool random, size_t iterations) {
+  void* ring[RING_SIZE];
+  memset(ring, 0, sizeof(ring));
+  uintptr_t r = tid + 1;
+  size_t ops = 0;
+  for (size_t i = 0; !stopped() && (iterations == 0 || i < iterations); i++) {
+    const size_t idx = i % RING_SIZE;
+    mi_free(ring[idx]);
+    const size_t size = (random ? random_size(&r) : 64);
+    ring[idx] = mi_malloc(size);
+    *((uint8_t*)ring[idx]) = (uint8_t)i;
+    ops++;
+  }
+  for (size_t i = 0; i < RING_SIZE; i++) { mi_free(ring[i]); }
+  counters[tid].ops += ops;
+}
+
+static void run_churn(size_t tid, size_t nthreads) {
+  (void)(nthreads);
+  churn(tid, false, 0);
+}
+
+static void run_random(size_t tid, size_t nthreads) {
+  (void)(nthreads);
+  churn(tid, true, 0);
+}
+
+// single producer/single consumer queues
+typedef struct queue_s {
+  void*  slots[QUEUE_SIZE];
+  size_t head;    // next slot to pop (written by the consumer)
+  size_t tail;    // next slot to push (written by the producer)
+} queue_t;
+static queue_t* queues;   // one per pair of threads
+
+static void run_prodcons(size_t tid, size_t nthreads) {
+  if (nthreads == 1 || (nthreads % 2 == 1 && tid == nthreads - 1)) {
+    churn(tid, true, 0);  // no partner
+    return;
+  }
+  queue_t* q = &queues[tid / 2];
+  size_t ops = 0;
+  if (tid % 2 == 0) {
+    // producer
+    uintptr_t r = tid + 1;
+    while (!stopped()) {
+      const size_t tail = q->tail;
+      if (tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) >= QUEUE_SIZE) { sched_yield(); continue; }
+      void* p = mi_malloc(random_size(&r));
+      *((uint8_t*)p) = (uint8_t)tail;
+      q->slots[tail % QUEUE_SIZE] = p;
+      __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    }
+  }
+  else {
+    // consumer: counts the operations for the pair
+    while (!stopped()) {
+      const size_t head = q->head;
+      if (head == __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)) { sched_yield(); continue; }
+      mi_free(q->slots[head % QUEUE_SIZE]);
+      __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+      ops++;
+    }
+  }
+  counters[tid].ops += ops;
+}
+
+static void* short_lived(void* arg) {
+  churn((size_t)(uintptr_t)arg, true, 100);
+  return NULL;
+}
+
+static void run_threads(size_t tid, size_t nthreads) {
+  (void)(nthreads);
+  while (!stopped()) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, &short_lived, (void*)(uintptr_t)tid) != 0) break;
+    pthread_join(thread, NULL);
+  }
+}
+
+static void count_block(void* base, size_t size, void* arg) {
+  (void)(base); (void)(size);
+  *((size_t*)arg) += 1;
+}
+
+static void run_iterate(size_t tid, size_t nthreads) {
+  if (tid != 0) {
+    churn(tid, true, 0);
+    return;
+  }
+  // thread 0 iterates all blocks every millisecond (and churns itself if it is alone)
+  while (!stopped()) {
+    if (nthreads == 1) { churn(tid, true, 10000); } else { usleep(1000); }
+    size_t blocks = 0;
+    mi_malloc_disable();  // required around `mi_malloc_iterate` (as with `malloc_iterate`)
+    mi_malloc_iterate(NULL, SIZE_MAX, &count_block, &blocks);
+    mi_malloc_enable();
+  }
+}
+
+typedef struct workload_s {
+  const char* name;
+  void (*run)(size_t tid, size_t nthreads);
+} workload_t;
+
+static const workload_t workloads[] = {
+  { "churn",    &run_churn },
+  { "random",   &run_random },
+  { "prodcons", &run_prodcons },
+  { "threads",  &run_threads },
+  { "iterate",  &run_iterate },
+};
+#define WORKLOAD_COUNT  (sizeof(workloads)/sizeof(workloads[0]))
+
+// ---------------------------------------------------------------------------
+// Running a workload with a given number of threads
+// ---------------------------------------------------------------------------
+
+typedef struct result_s {
+  const char* workload;
+  size_t nthreads;
+  size_t msecs;
+  size_t ops;
+  double ops_per_sec;
+  long   peak_rss_kib;
+  long   steady_rss_kib;
+  size_t commit_kib;
+  size_t page_faults;
+} result_t;
+
+typedef struct thread_arg_s {
+  const workload_t* workload;
+  size_t tid;
+  size_t nthreads;
+} thread_arg_t;
+
+static void* thread_entry(void* param) {
+  thread_arg_t* arg = (thread_arg_t*)param;
+  arg->workload->run(arg->tid, arg->nthreads);
+  return NULL;
+}
+
+static bool run_workload(const workload_t* workload, size_t nthreads, size_t msecs, result_t* res) {
+  memset(counters, 0, sizeof(counters));
+  const size_t npairs = (nthreads / 2) + 1;
+  queues = (queue_t*)mi_calloc(npairs, sizeof(queue_t));
+  if (queues == NULL) return false;
+  __atomic_store_n(&stop, false, __ATOMIC_RELEASE);
+  const size_t faults0 = page_faults();
+
+  pthread_t threads[MAX_THREADS];
+  thread_arg_t args[MAX_THREADS];
+  const int64_t start = now_msecs();
+  size_t started = 0;
+  for (; started < nthreads; started++) {
+    args[started].workload = workload;
+    args[started].tid = started;
+    args[started].nthreads = nthreads;
+    if (pthread_create(&threads[started], NULL, &thread_entry, &args[started]) != 0) break;
+  }
+
+  // sample the resident memory while the threads run
+  long peak = 0, steady_total = 0, steady_count = 0;
+  int64_t elapsed;
+  while ((elapsed = now_msecs() - start) < (int64_t)msecs) {
+    const long rss = rss_kib();
+    if (rss > peak) peak = rss;
+    if (elapsed >= (int64_t)msecs / 2) { steady_total += rss; steady_count++; }
+    usleep(5000);
+  }
+  __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+  for (size_t i = 0; i < started; i++) { pthread_join(threads[i], NULL); }
+  elapsed = now_msecs() - start;
+
+  // free any blocks still in the producer/consumer queues
+  for (size_t i = 0; i < npairs; i++) {
+    for (size_t j = queues[i].head; j != queues[i].tail; j++) { mi_free(queues[i].slots[j % QUEUE_SIZE]); }
+  }
+  mi_free(queues);
+  queues = NULL;
+
+  size_t ops = 0;
+  for (size_t i = 0; i < nthreads; i++) { ops += counters[i].ops; }
+  const size_t faults = page_faults();
+  size_t commit = 0;
+  mi_process_info(NULL, NULL, NULL, NULL, NULL, &commit, NULL, NULL);
+  res->workload = workload->name;
+  res->nthreads = nthreads;
+  res->msecs = (size_t)elapsed;
+  res->ops = ops;
+  res->ops_per_sec = (elapsed > 0 ? (double)ops * 1000.0 / (double)elapsed : 0.0);
+  res->peak_rss_kib = peak;
+  res->steady_rss_kib = (steady_count > 0 ? steady_total / steady_count : peak);
+  res->commit_kib = commit / 1024;
+  res->page_faults = faults - faults0;
+  mi_collect(true);
+  return (started == nthreads);
+}
+
+// ---------------------------------------------------------------------------
+// Main
+// ---------------------------------------------------------------------------
+
+static void print_result(FILE* out, const result_t* res, bool json, bool first) {
+  if (json) {
+    fprintf(out, "%s\n  { \"workload\": \"%s\", \"threads\": %zu, \"msecs\": %zu, \"ops\": %zu, \"ops_per_sec\": %.0f, "
+                 "\"peak_rss_kib\": %ld, \"steady_rss_kib\": %ld, \"commit_kib\": %zu, \"page_faults\": %zu }",
+                 (first ? "" : ","), res->workload, res->nthreads, res->msecs, res->ops, res->ops_per_sec,
+                 res->peak_rss_kib, res->steady_rss_kib, res->commit_kib, res->page_faults);
+  }
+  else {
+    fprintf(out, "%s,%zu,%zu,%zu,%.0f,%ld,%ld,%zu,%zu\n",
+                 res->workload, res->nthreads, res->msecs, res->ops, res->ops_per_sec,
+                 res->peak_rss_kib, res->steady_rss_kib, res->commit_kib, res->page_faults);
+  }
+  fflush(out);
+}
+
+int main(int argc, char** argv) {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t max_threads = (size_t)(cores > 0 ? 2*cores : 8);
+  size_t msecs = 500;
+  bool json = false;
+  const char* outname = NULL;
+  bool selected[WORKLOAD_COUNT];
+  bool any_selected = false;
+  memset(selected, 0, sizeof(selected));
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) { max_threads = (size_t)strtoul(argv[++i], NULL, 10); }
+    else if (strcmp(argv[i], "--ms") == 0 && i + 1 < argc) { msecs = (size_t)strtoul(argv[++i], NULL, 10); }
+    else if (strcmp(argv[i], "--json") == 0) { json = true; }
+    else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) { outname = argv[++i]; }
+    else if (strcmp(argv[i], "--workload") == 0 && i + 1 < argc) {
+      const char* name = argv[++i];
+      bool found = false;
+      for (size_t w = 0; w < WORKLOAD_COUNT; w++) {
+        if (strcmp(name, workloads[w].name) == 0) { selected[w] = true; found = true; }
+      }
+      if (!found) { fprintf(stderr, "unknown workload: %s\n", name); return 1; }
+      any_selected = true;
+    }
+    else {
+      fprintf(stderr, "usage: %s [--threads N] [--ms M] [--workload <name>] [--json] [--out <file>]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (max_threads < 1) max_threads = 1;
+  if (max_threads > MAX_THREADS) max_threads = MAX_THREADS;
+
+  FILE* out = stdout;
+  if (outname != NULL) {
+    out = fopen(outname, "w");
+    if (out == NULL) { fprintf(stderr, "error: cannot write %s\n", outname); return 1; }
+  }
+  if (json) fprintf(out, "[");
+  else fprintf(out, "workload,threads,msecs,ops,ops_per_sec,peak_rss_kib,steady_rss_kib,commit_kib,page_faults\n");
+
+  bool ok = true;
+  bool first = true;
+  for (size_t w = 0; w < WORKLOAD_COUNT && ok; w++) {
+    if (any_selected && !selected[w]) continue;
+    for (size_t n = 1; ok; n = (n*2 < max_threads ? n*2 : max_threads)) {
+      result_t res;
+      ok = run_workload(&workloads[w], n, msecs, &res);  // zero operations is reported, not an error
+      if (ok) print_result(out, &res, json, first);
+      first = false;
+      if (n == max_threads) break;
+    }
+  }
+  if (json) fprintf(out, "\n]\n");
+  if (out != stdout) fclose(out);
+  if (!ok) fprintf(stderr, "error: a workload failed to run\n");
+  return (ok ? 0 : 1);
+}
+#endif
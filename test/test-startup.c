@@ -0,0 +1,278 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2022, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* Measures the startup cost of mimalloc by starting fresh processes (this
+   program itself with `--child`) and reporting as JSON:
+   - `spawn_to_first_malloc_us`: from just before `fork` in the parent until
+     the first `mi_malloc` in the child returned (includes `exec` and loading),
+   - `main_to_first_malloc_us`: from the start of `main` until the first
+     `mi_malloc` returned (this is process initialization when it is lazy),
+   - `init_syscalls`: number of system calls up to the first allocation
+     (only with the `LD_PRELOAD` counter library built with `MI_STARTUP_SHIM`),
+   - `rss_kib`: resident memory after the first allocation.
+
+   Built as `mimalloc-test-startup` against the shared library and as
+   `mimalloc-test-startup-static` against the static library.
+   Usage: mimalloc-test-startup [--runs N] [--shim <path>] [--json <file>]
+*/
+
+#if defined(MI_STARTUP_SHIM)
+// ---------------------------------------------------------------------------
+// LD_PRELOAD library that counts the system calls made through these libc
+// wrappers. It calls `syscall` directly so it never allocates itself.
+// ---------------------------------------------------------------------------
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdarg.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#if defined(SYS_mmap)
+static long syscall_count = 0;
+
+long mi_startup_syscalls(void) {
+  return __atomic_load_n(&syscall_count, __ATOMIC_RELAXED);
+}
+
+static void count(void) {
+  __atomic_fetch_add(&syscall_count, 1, __ATOMIC_RELAXED);
+}
+
+void* mmap(void* addr, size_t size, int prot, int flags, int fd, off_t offset) {
+  count();
+  return (void*)syscall(SYS_mmap, addr, size, prot, flags, fd, offset);
+}
+
+int munmap(void* addr, size_t size) {
+  count();
+  return (int)syscall(SYS_munmap, addr, size);
+}
+
+int mprotect(void* addr, size_t size, int prot) {
+  count();
+  return (int)syscall(SYS_mprotect, addr, size, prot);
+}
+
+int madvise(void* addr, size_t size, int advice) {
+  count();
+  return (int)syscall(SYS_madvise, addr, size, advice);
+}
+
+int prctl(int option, ...) {
+  va_list args;
+  va_start(args, option);
+  unsigned long arg2 = va_arg(args, unsigned long);
+  unsigned long arg3 = va_arg(args, unsigned long);
+  unsigned long arg4 = va_arg(args, unsigned long);
+  unsigned long arg5 = va_arg(args, unsigned long);
+  va_end(args);
+  count();
+  return (int)syscall(SYS_prctl, option, arg2, arg3, arg4, arg5);
+}
+
+int open(const char* path, int flags, ...) {
+  va_list args;
+  va_start(args, flags);
+  int mode = ((flags & O_CREAT) != 0 ? va_arg(args, int) : 0);
+  va_end(args);
+  count();
+  return (int)syscall(SYS_openat, AT_FDCWD, path, flags, mode);
+}
+
+ssize_t read(int fd, void* buf, size_t count_) {
+  count();
+  return (ssize_t)syscall(SYS_read, fd, buf, count_);
+}
+
+int close(int fd) {
+  count();
+  return (int)syscall(SYS_close, fd);
+}
+
+#if defined(SYS_getrandom)
+ssize_t getrandom(void* buf, size_t buflen, unsigned int flags) {
+  count();
+  return (ssize_t)syscall(SYS_getrandom, buf, buflen, flags);
+}
+#endif
+#endif
+
+#else
+// ---------------------------------------------------------------------------
+// Benchmark
+// ---------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "mimalloc.h"
+
+#ifndef MI_STARTUP_LIBRARY
+#define MI_STARTUP_LIBRARY "shared"
+#endif
+
+#if defined(_WIN32)
+int main(void) {
+  fprintf(stderr, "the startup benchmark needs fork/exec; skipped.\n");
+  return 0;
+}
+#else
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// resolved to the counter in the `LD_PRELOAD` library if present
+extern long mi_startup_syscalls(void) __attribute__((weak));
+
+static int64_t now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((int64_t)t.tv_sec * 1000000000) + t.tv_nsec;
+}
+
+static long rss_kib(void) {
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f == NULL) return -1;
+  long size = 0, resident = -1;
+  if (fscanf(f, "%ld %ld", &size, &resident) != 2) resident = -1;
+  fclose(f);
+  return (resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024));
+}
+
+// The child: allocate once and report the measurements on stdout.
+static int run_child(int64_t main_start) {
+  void* p = mi_malloc(16);
+  const int64_t done = now_ns();
+  const long syscalls = (mi_startup_syscalls != NULL ? mi_startup_syscalls() : -1);
+  const long rss = rss_kib();
+  printf("%lld %lld %ld %ld\n", (long long)done, (long long)(done - main_start), syscalls, rss);
+  mi_free(p);
+  return (p == NULL ? 1 : 0);
+}
+
+typedef struct sample_s {
+  double spawn_us;
+  double main_us;
+  long   syscalls;
+  long   rss_kib;
+} sample_t;
+
+// Start one child and collect its measurements.
+static int run_one(const char* self, const char* shim, sample_t* s) {
+  int fds[2];
+  if (pipe(fds) != 0) return -1;
+  const int64_t start = now_ns();
+  const pid_t pid = fork();
+  if (pid < 0) { close(fds[0]); close(fds[1]); return -1; }
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[0]); close(fds[1]);
+    if (shim != NULL) { setenv("LD_PRELOAD", shim, 1); }
+    execl(self, self, "--child", (char*)NULL);
+    _exit(127);
+  }
+  close(fds[1]);
+  char buf[256];
+  ssize_t n = 0, total = 0;
+  while (total < (ssize_t)sizeof(buf) - 1 && (n = read(fds[0], buf + total, sizeof(buf) - 1 - (size_t)total)) > 0) {
+    total += n;
+  }
+  buf[total] = 0;
+  close(fds[0]);
+  int status = 0;
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+  long long done = 0, main_ns = 0;
+  if (sscanf(buf, "%lld %lld %ld %ld", &done, &main_ns, &s->syscalls, &s->rss_kib) != 4) return -1;
+  s->spawn_us = (double)(done - start) / 1000.0;
+  s->main_us = (double)main_ns / 1000.0;
+  return 0;
+}
+
+static int compare_double(const void* a, const void* b) {
+  const double x = *(const double*)a, y = *(const double*)b;
+  return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+// Write the min/median/p90 of `count` values as a JSON object.
+static void print_stats(FILE* out, const char* name, double* xs, size_t count, const char* sep) {
+  qsort(xs, count, sizeof(double), &compare_double);
+  fprintf(out, "  \"%s\": { \"min\": %.1f, \"median\": %.1f, \"p90\": %.1f }%s\n",
+          name, xs[0], xs[count / 2], xs[(count * 9) / 10], sep);
+}
+
+int main(int argc, char** argv) {
+  const int64_t main_start = now_ns();
+  if (argc > 1 && strcmp(argv[1], "--child") == 0) return run_child(main_start);
+
+  size_t runs = 200;
+  const char* shim = NULL;
+  const char* json = NULL;
+  #if defined(MI_STARTUP_SHIM_PATH)
+  shim = MI_STARTUP_SHIM_PATH;
+  #endif
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) { runs = (size_t)strtoul(argv[++i], NULL, 10); }
+    else if (strcmp(argv[i], "--shim") == 0 && i + 1 < argc) { shim = argv[++i]; }
+    else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) { json = argv[++i]; }
+    else {
+      fprintf(stderr, "usage: %s [--runs N] [--shim <path>] [--json <file>]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (runs == 0) runs = 1;
+  if (shim != NULL && access(shim, R_OK) != 0) shim = NULL;
+
+  double* spawn_us = (double*)calloc(runs, sizeof(double));
+  double* main_us  = (double*)calloc(runs, sizeof(double));
+  double* syscalls = (double*)calloc(runs, sizeof(double));
+  double* rss      = (double*)calloc(runs, sizeof(double));
+  if (spawn_us == NULL || main_us == NULL || syscalls == NULL || rss == NULL) return 1;
+  bool counted = true;
+  for (size_t i = 0; i < runs; i++) {
+    sample_t s;
+    if (run_one(argv[0], shim, &s) != 0) {
+      fprintf(stderr, "error: child process %zu failed\n", i);
+      return 1;
+    }
+    spawn_us[i] = s.spawn_us;
+    main_us[i]  = s.main_us;
+    syscalls[i] = (double)s.syscalls;
+    rss[i]      = (double)s.rss_kib;
+    if (s.syscalls < 0) counted = false;
+  }
+
+  FILE* out = stdout;
+  if (json != NULL) {
+    out = fopen(json, "w");
+    if (out == NULL) { fprintf(stderr, "error: cannot write %s\n", json); return 1; }
+  }
+  fprintf(out, "{\n");
+  fprintf(out, "  \"library\": \"%s\",\n", MI_STARTUP_LIBRARY);
+  fprintf(out, "  \"version\": %d,\n", mi_version());
+  fprintf(out, "  \"runs\": %zu,\n", runs);
+  print_stats(out, "spawn_to_first_malloc_us", spawn_us, runs, ",");
+  print_stats(out, "main_to_first_malloc_us", main_us, runs, ",");
+  if (counted) {
+    print_stats(out, "init_syscalls", syscalls, runs, ",");
+  }
+  else {
+    fprintf(out, "  \"init_syscalls\": null,\n");
+  }
+  print_stats(out, "rss_kib", rss, runs, "");
+  fprintf(out, "}\n");
+  if (out != stdout) fclose(out);
+  free(spawn_us); free(main_us); free(syscalls); free(rss);
+  return 0;
+}
+#endif
+#endif
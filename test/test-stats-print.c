@@ -46,6 +46,7 @@ static const char *strings_to_parse[] = {
     "-abandoned",
     "-extended",
     "-noretire",
+    "-reused",
     "mmaps",
     "commits",
     "threads",